@@ -0,0 +1,146 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <queue>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "Image.h"
+#include "ZBuffer.h"
+
+// Imagem de cor e buffer de profundidade de um quadro.
+// O ZBuffer guarda uma referência para color, então o quadro não é copiado.
+struct AnimationFrame{
+	ImageRGB color;
+	ImageZBuffer zbuffer;
+
+	AnimationFrame(int w, int h): color{w, h}, zbuffer{color}{}
+	AnimationFrame(const AnimationFrame&) = delete;
+};
+
+// Quadros livres para reutilização. No máximo max_frames existem ao mesmo
+// tempo; acquire espera um quadro ser devolvido quando todos estão em uso.
+class FramePool{
+	int w, h, max_frames;
+	std::vector<std::unique_ptr<AnimationFrame>> frames;
+	std::vector<AnimationFrame*> available;
+	std::mutex m;
+	std::condition_variable cv;
+
+	public:
+	FramePool(int w, int h, int max_frames): w{w}, h{h}, max_frames{max_frames}{}
+
+	AnimationFrame* acquire(){
+		std::unique_lock<std::mutex> lock{m};
+		if(available.empty() && (int)frames.size() < max_frames){
+			frames.push_back(std::make_unique<AnimationFrame>(w, h));
+			return frames.back().get();
+		}
+		cv.wait(lock, [&]{ return !available.empty(); });
+		AnimationFrame* frame = available.back();
+		available.pop_back();
+		return frame;
+	}
+
+	void release(AnimationFrame* frame){
+		{
+			std::lock_guard<std::mutex> lock{m};
+			available.push_back(frame);
+		}
+		cv.notify_one();
+	}
+};
+
+// Salva os quadros prontos numa thread separada, enquanto os próximos são
+// renderizados, e devolve cada quadro salvo ao pool
+class FrameEncoder{
+	std::string pattern;
+	FramePool& pool;
+	std::queue<std::pair<int, AnimationFrame*>> pending;
+	bool done = false;
+	std::mutex m;
+	std::condition_variable cv;
+	std::thread worker;
+
+	public:
+	// pattern é um formato de printf com o número do quadro, como "anim/output%03d.png"
+	FrameEncoder(std::string pattern, FramePool& pool):
+		pattern{pattern}, pool{pool}, worker{[this]{ run(); }}
+	{}
+
+	~FrameEncoder(){
+		finish();
+	}
+
+	void push(int k, AnimationFrame* frame){
+		{
+			std::lock_guard<std::mutex> lock{m};
+			pending.push({k, frame});
+		}
+		cv.notify_one();
+	}
+
+	// Espera todos os quadros pendentes serem salvos
+	void finish(){
+		{
+			std::lock_guard<std::mutex> lock{m};
+			done = true;
+		}
+		cv.notify_one();
+		if(worker.joinable())
+			worker.join();
+	}
+
+	private:
+	void run(){
+		for(;;){
+			std::pair<int, AnimationFrame*> item;
+			{
+				std::unique_lock<std::mutex> lock{m};
+				cv.wait(lock, [&]{ return done || !pending.empty(); });
+				if(pending.empty())
+					return;
+				item = pending.front();
+				pending.pop();
+			}
+
+			char filename[256];
+			snprintf(filename, sizeof(filename), pattern.c_str(), item.first);
+			puts(filename);
+			item.second->color.savePNG(filename);
+			pool.release(item.second);
+		}
+	}
+};
+
+// Renderiza os quadros 0..nframes-1 de uma animação, vários ao mesmo tempo
+// (um por thread do OpenMP), e salva cada um com o nome dado por pattern.
+// render_frame(k, zbuffer) desenha o quadro k num buffer já limpo com a cor
+// background; ela é chamada em paralelo, então deve usar sua própria cópia
+// do shader e de qualquer outro estado que modifique.
+template<class RenderFrame>
+void render_animation(int nframes, int w, int h, RGB background, std::string pattern, RenderFrame render_frame){
+	int nthreads = 1;
+#ifdef _OPENMP
+	nthreads = omp_get_max_threads();
+#endif
+	// dois quadros a mais para o codificador trabalhar sem segurar as threads
+	FramePool pool{w, h, nthreads + 2};
+	FrameEncoder encoder{pattern, pool};
+
+	#pragma omp parallel for schedule(dynamic, 1)
+	for(int k = 0; k < nframes; k++){
+		AnimationFrame* frame = pool.acquire();
+		frame->color.fill(background);
+		frame->zbuffer.clear();
+		render_frame(k, frame->zbuffer);
+		encoder.push(k, frame);
+	}
+
+	encoder.finish();
+}
@@ -0,0 +1,49 @@
+#ifndef AREA_LIGHT_H
+#define AREA_LIGHT_H
+
+#include "vec.h"
+#include <algorithm>
+#include <numeric>
+
+// Luz retangular: pontos center + s*u + t*v, com s e t em [-1/2, 1/2]
+struct AreaLight{
+    vec3 center;
+    vec3 u, v;
+
+    // Ponto no estrato (i, j) de uma grade n x n, deslocado por (r1, r2) em [0, 1)
+    vec3 sample(int i, int j, int n, float r1, float r2) const{
+        float s = (i + r1)/n - 0.5f;
+        float t = (j + r2)/n - 0.5f;
+        return center + s*u + t*v;
+    }
+};
+
+// Fração da luz visível a partir de p, com até n*n amostras estratificadas.
+// Se as k primeiras amostras concordam (todas visíveis ou todas bloqueadas)
+// o ponto é tratado como totalmente iluminado ou em sombra e as demais não
+// são disparadas; só na penumbra são usadas todas as amostras.
+// blocked(p, q) diz se o segmento p-q está obstruído; random01() sorteia em [0, 1).
+template<class Blocked, class Random>
+float light_visibility(const AreaLight& light, vec3 p, int n, int k, Blocked blocked, Random random01){
+    int N = n*n;
+
+    // percorre os estratos com passo próximo da razão áurea, primo com N,
+    // para que as primeiras amostras fiquem espalhadas pela luz
+    int step = std::max(1, (int)(0.618f*N));
+    while(std::gcd(step, N) != 1)
+        step++;
+
+    int visible = 0;
+    for(int m = 0; m < N; m++){
+        int s = (m*step) % N;
+        vec3 q = light.sample(s % n, s / n, n, random01(), random01());
+        if(!blocked(p, q))
+            visible++;
+
+        if(m+1 == k && (visible == 0 || visible == k))
+            return visible/(float)k;
+    }
+    return visible/(float)N;
+}
+
+#endif
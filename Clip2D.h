@@ -1,6 +1,7 @@
 #ifndef CLIP2D_H
 #define CLIP2D_H
 
+#include <cassert>
 #include "Primitives.h"
 
 struct Semiplane{
@@ -25,24 +26,162 @@ struct ClipRectangle{
 			Semiplane{ {x1, y1}, { 0, -1} }, // up
 		};
 	}
-};
 
+	// Bit k ligado se P está fora do lado k de sides() (bordas contam como dentro)
+	unsigned int outcode(vec2 P) const{
+		return (P[0] < x0) | (P[0] > x1) << 1 | (P[1] < y0) << 2 | (P[1] > y1) << 3;
+	}
+};
 
+// Outcodes para aceitar ou rejeitar a linha inteira de uma vez; as demais
+// são recortadas por Liang–Barsky. Os dois extremos novos são interpolados
+// a partir dos originais. Retorna false se nada da linha sobrar.
 template<class Vertex>
 bool clip(Line<Vertex>& line, ClipRectangle rect){
-	/**************** TAREFA - AULA 09 **************/
+	vec2 P = get2DPosition(line[0]);
+	vec2 Q = get2DPosition(line[1]);
+
+	unsigned int cP = rect.outcode(P), cQ = rect.outcode(Q);
+	if((cP | cQ) == 0)
+		return true;
+	if(cP & cQ)
+		return false;
+
+	vec2 d = Q - P;
+	float p[] = { -d[0], d[0], -d[1], d[1] };
+	float q[] = { P[0] - rect.x0, rect.x1 - P[0], P[1] - rect.y0, rect.y1 - P[1] };
+
+	float t0 = 0, t1 = 1;
+	for(int k = 0; k < 4; k++){
+		if(p[k] == 0){
+			if(q[k] < 0)
+				return false;
+			continue;
+		}
+		float t = q[k]/p[k];
+		if(p[k] < 0)
+			t0 = std::max(t0, t);
+		else
+			t1 = std::min(t1, t);
+	}
+	if(t0 > t1)
+		return false;
+
+	Line<Vertex> original = line;
+	if(t0 > 0)
+		line[0] = lerp(t0, original[0], original[1]);
+	if(t1 < 1)
+		line[1] = lerp(t1, original[0], original[1]);
 	return true;
 }
 
+template<class Vertex, class Emit>
+void clip(Line<Vertex> line, ClipRectangle rect, Emit emit){
+	if(clip(line, rect))
+		emit(line);
+}
+
 template<class Vertex>
 std::vector<Line<Vertex>> clip(const std::vector<Line<Vertex>>& lines, ClipRectangle rect){
 	std::vector<Line<Vertex>> res;
-	for(Line<Vertex> line: lines)
-		if(clip(line, rect))
-			res.push_back(line);
+	res.reserve(lines.size());
+	for(const Line<Vertex>& line: lines)
+		clip(line, rect, [&](const Line<Vertex>& l){ res.push_back(l); });
 	return res;
 }
 
+// Polígono de tamanho fixo para o recorte de triângulos sem alocação:
+// cada lado do retângulo acrescenta no máximo um vértice, então um
+// triângulo recortado tem no máximo sete.
+
+template<class Vertex>
+struct ClipPolygon2D{
+	static const int MAX = 7;
+	Vertex v[MAX];
+	int n = 0;
+};
+
+template<class Vertex>
+void clip(const ClipPolygon2D<Vertex>& polygon, Semiplane S, ClipPolygon2D<Vertex>& R){
+	// vértices além de MAX (cruzamentos a mais por erro numérico) são descartados
+	auto emit = [&R](const Vertex& v){
+		assert(R.n < ClipPolygon2D<Vertex>::MAX);
+		if(R.n < ClipPolygon2D<Vertex>::MAX)
+			R.v[R.n++] = v;
+	};
+
+	R.n = 0;
+	for(int i = 0; i < polygon.n; i++){
+		const Vertex& P = polygon.v[i];
+		const Vertex& Q = polygon.v[(i+1) % polygon.n];
+
+		vec2 p = get2DPosition(P);
+		vec2 q = get2DPosition(Q);
+
+		bool Pin = S.has(p);
+		bool Qin = S.has(q);
+
+		if(Pin != Qin)
+			emit(lerp(S.intersect(p, q), P, Q));
+
+		if(Qin)
+			emit(Q);
+	}
+}
+
+// Recorta o triângulo só pelos lados que os vértices cruzam.
+// Retorna false se sobrar menos que um triângulo.
+template<class Vertex>
+bool clip(const Triangle<Vertex>& tri, ClipRectangle rect, ClipPolygon2D<Vertex>& R){
+	R.n = 3;
+	R.v[0] = tri[0];
+	R.v[1] = tri[1];
+	R.v[2] = tri[2];
+
+	unsigned int c[] = {
+		rect.outcode(get2DPosition(tri[0])),
+		rect.outcode(get2DPosition(tri[1])),
+		rect.outcode(get2DPosition(tri[2]))
+	};
+	if(c[0] & c[1] & c[2])
+		return false;
+
+	unsigned int mask = c[0] | c[1] | c[2];
+	if(mask == 0)
+		return true;
+
+	ClipPolygon2D<Vertex> tmp;
+	ClipPolygon2D<Vertex>* in = &R;
+	ClipPolygon2D<Vertex>* out = &tmp;
+
+	std::array<Semiplane, 4> sides = rect.sides();
+	for(int k = 0; k < 4; k++){
+		if(!(mask >> k & 1))
+			continue;
+		clip(*in, sides[k], *out);
+		std::swap(in, out);
+		if(in->n < 3){
+			R.n = 0;
+			return false;
+		}
+	}
+
+	if(in != &R)
+		R = *in;
+	return true;
+}
+
+// Chama emit com cada triângulo do leque da parte visível
+template<class Vertex, class Emit>
+void clip(const Triangle<Vertex>& tri, ClipRectangle rect, Emit emit){
+	ClipPolygon2D<Vertex> polygon;
+	if(!clip(tri, rect, polygon))
+		return;
+
+	for(int i = 1; i+1 < polygon.n; i++)
+		emit(Triangle<Vertex>{polygon.v[0], polygon.v[i], polygon.v[i+1]});
+}
+
 template<class Vertex>
 std::vector<Vertex> clip(const std::vector<Vertex>& polygon, Semiplane S){
 	std::vector<Vertex> R;
@@ -79,14 +218,10 @@ std::vector<Vertex> clip(const std::vector<Vertex>& polygon, ClipRectangle rect)
 template<class Vertex>
 std::vector<Triangle<Vertex>> clip(const std::vector<Triangle<Vertex>>& tris, ClipRectangle R){
 	std::vector<Triangle<Vertex>> res;
+	res.reserve(tris.size());
 
-	for(Triangle<Vertex> tri: tris){
-		std::vector<Vertex> polygon = {tri[0], tri[1], tri[2]};
-		polygon = clip(polygon, R);
-		TriangleFan T{polygon.size()};
-		for(Triangle<Vertex> tri: assemble(T, polygon))
-			res.push_back(tri);
-	}
+	for(const Triangle<Vertex>& tri: tris)
+		clip(tri, R, [&](const Triangle<Vertex>& t){ res.push_back(t); });
 
 	return res;
 }
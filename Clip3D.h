@@ -1,8 +1,10 @@
 #ifndef CLIP3D_H
 #define CLIP3D_H
+#include <cassert>
 #include "vec.h"
 #include "VertexUtils.h"
 #include "Primitives.h"
+#include "VaryingUtils.h"
 
 inline std::array<vec4, 6> normals(){
 	return {
@@ -15,6 +17,33 @@ inline std::array<vec4, 6> normals(){
 	};
 }
 
+// Banda de guarda: x e y só são recortados em |x|, |y| <= GUARD_BAND*w;
+// o que passa da tela dentro da banda é descartado pelo scissor do
+// rasterizador. A banda é pequena o bastante para as coordenadas de tela
+// caberem no ponto fixo do rasterizador.
+const float GUARD_BAND = 8;
+
+inline std::array<vec4, 6> guard_band_normals(){
+	const float K = GUARD_BAND;
+	return {
+		vec4{ 0,  0, -1,  1},
+		vec4{ 0,  0,  1,  1},
+		vec4{ 1,  0,  0,  K},
+		vec4{-1,  0,  0,  K},
+		vec4{ 0,  1,  0,  K},
+		vec4{ 0, -1,  0,  K}
+	};
+}
+
+// Bit k ligado se P está fora do k-ésimo plano de N
+inline unsigned int outcode(vec4 P, const std::array<vec4, 6>& N = normals()){
+	unsigned int code = 0;
+	for(int k = 0; k < 6; k++)
+		if(dot(P, N[k]) < 0)
+			code |= 1u << k;
+	return code;
+}
+
 template<class Varying>
 bool clip(Line<Varying>& line){
 	vec4 A = getPosition(line[0]);
@@ -48,8 +77,8 @@ bool clip(Line<Varying>& line){
 	}
 
 	Line<Varying> copy = line;
-	line[0] = (1-t_in)*copy[0] + t_in*copy[1];
-	line[1] = (1-t_out)*copy[0] + t_out*copy[1];
+	line[0] = varying_lerp(t_in, copy[0], copy[1]);
+	line[1] = varying_lerp(t_out, copy[0], copy[1]);
 
 	return true;
 }
@@ -85,7 +114,7 @@ std::vector<Varying> clip(const std::vector<Varying>& polygon, vec4 n){
 		if(Pin!=Qin){
 			float t = peP/(peP-peQ);
 
-			Varying p = (1-t)*P+t*Q;//lerp(t, P, Q);
+			Varying p = varying_lerp(t, P, Q);
 			R.push_back(p);
 		}
 		if(Qin)
@@ -105,6 +134,78 @@ std::vector<Varying> clip(const std::vector<Varying>& polygon){
 	return R;
 }
 
+/******************************************************************************/
+// Recorte sem alocação. Cada plano acrescenta no máximo um vértice, então
+// um triângulo recortado pelos seis planos tem no máximo nove.
+
+template<class Varying>
+struct ClipPolygon{
+	static const int MAX = 9;
+	Varying v[MAX];
+	int n = 0;
+};
+
+template<class Varying>
+void clip(const ClipPolygon<Varying>& polygon, vec4 n, ClipPolygon<Varying>& R){
+	// Com testes inconsistentes em entradas quase coplanares poderia haver
+	// mais cruzamentos que o esperado: os vértices além de MAX são descartados
+	auto emit = [&R](const Varying& v){
+		assert(R.n < ClipPolygon<Varying>::MAX);
+		if(R.n < ClipPolygon<Varying>::MAX)
+			R.v[R.n++] = v;
+	};
+
+	R.n = 0;
+	for(int i = 0; i < polygon.n; i++){
+		const Varying& P = polygon.v[i];
+		const Varying& Q = polygon.v[(i+1) % polygon.n];
+
+		float peP = dot(getPosition(P), n),
+			  peQ = dot(getPosition(Q), n);
+
+		bool Pin = peP>=0,
+			 Qin = peQ>=0;
+
+		if(Pin!=Qin){
+			float t = peP/(peP-peQ);
+			emit(varying_lerp(t, P, Q));
+		}
+		if(Qin)
+			emit(Q);
+	}
+}
+
+// Recorta o triângulo pelos planos de N cujos bits estão em mask.
+// Retorna false se sobrar menos que um triângulo.
+template<class Varying>
+bool clip(const Triangle<Varying>& tri, ClipPolygon<Varying>& R,
+	unsigned int mask = 0x3F, const std::array<vec4, 6>& N = normals())
+{
+	ClipPolygon<Varying> tmp;
+	ClipPolygon<Varying>* in = &R;
+	ClipPolygon<Varying>* out = &tmp;
+
+	R.n = 3;
+	R.v[0] = tri[0];
+	R.v[1] = tri[1];
+	R.v[2] = tri[2];
+
+	for(int k = 0; k < 6; k++){
+		if(!(mask >> k & 1))
+			continue;
+		clip(*in, N[k], *out);
+		std::swap(in, out);
+		if(in->n < 3){
+			R.n = 0;
+			return false;
+		}
+	}
+
+	if(in != &R)
+		R = *in;
+	return true;
+}
+
 template<class Varying>
 std::vector<Triangle<Varying>> clip(const std::vector<Triangle<Varying>>& tris){
 	std::vector<Triangle<Varying>> res;
@@ -1,23 +1,35 @@
 #pragma once
 
 #include "Image.h"
+#include "Sampler2D.h"
 #include <string>
 #include <map>
 
 class ImageSet{
-	std::map<std::string, ImageRGB> texture_map;
+	// Cada textura (bilinear, repetida) com seus mipmaps, gerados uma só
+	// vez no carregamento
+	std::map<std::string, Sampler2D> texture_map;
 	public:
 
 	void load_texture(std::string path, std::string file){			
 		if(file != "" && texture_map.find(file) == texture_map.end()){
 			std::string img = path + file;
 			std::cout << "read image " << img << '\n';
-			texture_map[file] = ImageRGB{img};
+			Sampler2D& sampler = texture_map[file];
+			sampler = Sampler2D{ImageRGB{img}, BILINEAR, REPEAT, REPEAT};
+			sampler.generateMipmaps();
 		}
 	}
 
 	void get_texture(std::string file, ImageRGB& img) const{
 		auto it = texture_map.find(file);
-		img = (it != texture_map.end())? it->second: ImageRGB{};
+		img = (it != texture_map.end())? it->second.img: ImageRGB{};
+	}
+
+	// Sampler com a imagem e os mipmaps da textura, sem cópia (nullptr se
+	// não foi carregada). O ponteiro vale enquanto o ImageSet existir.
+	const Sampler2D* get_sampler(std::string file) const{
+		auto it = texture_map.find(file);
+		return (it != texture_map.end())? &it->second: nullptr;
 	}
 };
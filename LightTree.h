@@ -0,0 +1,306 @@
+#ifndef LIGHT_TREE_H
+#define LIGHT_TREE_H
+
+#include "RTMesh.h"
+
+/**************************** EMISSORES *****************************/
+// Triângulo emissor (material com illum 0) em coordenadas do mundo
+struct Emitter{
+    ObjTriangle tri;
+    vec3 normal;     // normal geométrica, lado que emite
+    float area;
+    float power;     // potência estimada: pi * area * radiância média
+    const MaterialInfo* material;
+
+    // Ponto uniforme no triângulo e a radiância emitida nele
+    void sample(float u1, float u2, vec3& position, vec3& Le) const{
+        float su = sqrt(u1);
+        float b0 = 1 - su;
+        float b1 = u2*su;
+        float b2 = 1 - b0 - b1;
+
+        vec2 texCoords = b0*tri[0].texCoords + b1*tri[1].texCoords + b2*tri[2].texCoords;
+        MaterialInfo mat = *material;
+        sample_textures(mat, texCoords);
+
+        position = b0*tri[0].position + b1*tri[1].position + b2*tri[2].position;
+        Le = mat.Kd;
+    }
+};
+
+// Coleta os triângulos emissores de todas as malhas.
+// Os ponteiros para os materiais ficam válidos enquanto as malhas existirem.
+inline std::vector<Emitter> get_emitters(const std::vector<RTMesh>& meshes){
+    std::vector<Emitter> emitters;
+    for(const RTMesh& mesh: meshes){
+        mat4 M = mesh.get_model_matrix();
+        mat3 MN = mesh.get_normal_matrix();
+
+        for(const MeshRange& range: mesh.get_ranges()){
+            const MaterialInfo& mat = range.get_material();
+            if(mat.illum != 0)
+                continue;
+
+            float radiance = (mat.Kd[0] + mat.Kd[1] + mat.Kd[2])/3;
+            if(radiance <= 0)
+                continue;
+
+            for(ObjTriangle tri: range.get_triangles()){
+                for(ObjVertex& v: tri){
+                    v.position = toVec3(M*toVec4(v.position, 1));
+                    v.normal = MN*v.normal;
+                }
+
+                vec3 c = cross(tri[1].position - tri[0].position, tri[2].position - tri[0].position);
+                float area = norm(c)/2;
+                if(area <= 0)
+                    continue;
+
+                // emite do lado para onde apontam as normais dos vértices
+                vec3 n = (1/(2*area))*c;
+                if(dot(n, tri[0].normal + tri[1].normal + tri[2].normal) < 0)
+                    n = -n;
+
+                emitters.push_back({tri, n, area, (float)M_PI*area*radiance, &mat});
+            }
+        }
+    }
+    return emitters;
+}
+
+/**************************** CONE DE DIREÇÕES *****************************/
+inline float safe_acos(float x){
+    return acos(clamp(x, -1.0f, 1.0f));
+}
+
+struct DirectionCone{
+    vec3 w = vec3{0, 0, 1};
+    float cos_theta = -1;   // cosseno do semi-ângulo; -1 = esfera toda
+
+    friend DirectionCone merge(const DirectionCone& a, const DirectionCone& b){
+        DirectionCone sphere;
+        if(a.cos_theta == -1 || b.cos_theta == -1)
+            return sphere;
+
+        float theta_a = safe_acos(a.cos_theta);
+        float theta_b = safe_acos(b.cos_theta);
+        float theta_d = safe_acos(dot(a.w, b.w));
+
+        if(std::min(theta_d + theta_b, (float)M_PI) <= theta_a)
+            return a;
+        if(std::min(theta_d + theta_a, (float)M_PI) <= theta_b)
+            return b;
+
+        float theta_o = (theta_a + theta_d + theta_b)/2;
+        if(theta_o >= M_PI)
+            return sphere;
+
+        // gira a.w em direção a b.w
+        vec3 wr = cross(a.w, b.w);
+        if(norm2(wr) < 1e-12)
+            return sphere;
+
+        float theta_r = theta_o - theta_a;
+        vec3 k = normalize(wr);
+        vec3 w = cos(theta_r)*a.w + sin(theta_r)*cross(k, a.w);
+        return {normalize(w), cosf(theta_o)};
+    }
+};
+
+/**************************** LIMITES DE UM GRUPO DE LUZES *****************************/
+// Caixa envolvente, cone de orientação das normais e potência total.
+// Todos os emissores são de um lado só: emitem até pi/2 em torno da normal.
+struct LightBounds{
+    BoundingBox box;
+    DirectionCone cone;
+    float power = 0;
+
+    LightBounds() = default;
+
+    LightBounds(const Emitter& E) : cone{E.normal, 1}, power{E.power}{
+        for(const ObjVertex& v: E.tri)
+            box.add(v.position);
+    }
+
+    friend LightBounds merge(const LightBounds& a, const LightBounds& b){
+        LightBounds r;
+        r.box = a.box;
+        r.box.add(b.box.min());
+        r.box.add(b.box.max());
+        r.cone = merge(a.cone, b.cone);
+        r.power = a.power + b.power;
+        return r;
+    }
+
+    // Estimativa conservadora da contribuição do grupo para o ponto p com normal n
+    float importance(vec3 p, vec3 n) const{
+        vec3 pc = box.mid_point();
+        vec3 diag = box.max() - box.min();
+        float radius = norm(diag)/2;
+
+        float dist2 = norm2(p - pc);
+        float d2 = std::max(dist2, radius);
+        vec3 wi = normalize(p - pc);
+        if(dist2 == 0)
+            wi = cone.w;
+
+        // cone de direções que a caixa ocupa vista de p
+        float theta_b = (float)M_PI;
+        if(dist2 > radius*radius)
+            theta_b = asin(radius/sqrt(dist2));
+
+        float theta_w = safe_acos(dot(cone.w, wi));
+        float theta_o = safe_acos(cone.cos_theta);
+        float theta_x = std::max(0.0f, theta_w - theta_o - theta_b);
+        if(theta_x >= M_PI/2)
+            return 0;
+
+        float I = power*cos(theta_x)/d2;
+
+        float theta_i = safe_acos(fabs(dot(wi, n)));
+        I *= cos(std::max(0.0f, theta_i - theta_b));
+
+        return std::max(I, 0.0f);
+    }
+};
+
+/**************************** AMOSTRA DE LUZ *****************************/
+struct LightSample{
+    vec3 position;
+    vec3 normal;
+    vec3 Le;        // radiância emitida
+    float pdf;      // densidade em relação à área
+    int emitter;
+};
+
+/**************************** HIERARQUIA DE LUZES *****************************/
+// BVH sobre os emissores. A amostragem desce a árvore escolhendo cada
+// filho com probabilidade proporcional à sua importância estimada,
+// com custo O(log n) por amostra.
+class LightTree{
+    struct Node{
+        LightBounds bounds;
+        int child = -1;     // segundo filho; o primeiro é o nó seguinte
+        int emitter = -1;   // índice do emissor nas folhas
+    };
+
+    std::vector<Emitter> emitters;
+    std::vector<Node> nodes;
+    std::vector<float> power_cdf;   // distribuição independente do ponto, proporcional à potência
+
+    public:
+    LightTree() = default;
+
+    LightTree(std::vector<Emitter> _emitters) : emitters{std::move(_emitters)}{
+        if(emitters.empty())
+            return;
+
+        std::vector<int> index(emitters.size());
+        for(unsigned int i = 0; i < index.size(); i++)
+            index[i] = i;
+
+        nodes.reserve(2*emitters.size());
+        build(index, 0, index.size());
+
+        float sum = 0;
+        for(const Emitter& E: emitters){
+            sum += E.power;
+            power_cdf.push_back(sum);
+        }
+    }
+
+    bool empty() const{ return nodes.empty(); }
+    size_t size() const{ return emitters.size(); }
+    const Emitter& get_emitter(int i) const{ return emitters[i]; }
+    float total_power() const{ return power_cdf.empty()? 0: power_cdf.back(); }
+
+    // Escolhe um emissor com probabilidade proporcional à potência (origem
+    // de subcaminhos de luz). Retorna -1 se não houver emissores.
+    int sample_by_power(float u, float& pmf) const{
+        if(power_cdf.empty())
+            return -1;
+
+        int i = std::upper_bound(power_cdf.begin(), power_cdf.end(), u*total_power()) - power_cdf.begin();
+        i = std::min(i, (int)emitters.size()-1);
+        pmf = emitters[i].power/total_power();
+        return i;
+    }
+
+    // Amostra um ponto em alguma luz, visto do ponto p com normal n.
+    // u escolhe a luz, (u1, u2) o ponto no triângulo.
+    bool sample(vec3 p, vec3 n, float u, float u1, float u2, LightSample& s) const{
+        if(nodes.empty())
+            return false;
+
+        int i = 0;
+        float pmf = 1;
+        while(nodes[i].emitter < 0){
+            int c0 = i+1;
+            int c1 = nodes[i].child;
+            float I0 = nodes[c0].bounds.importance(p, n);
+            float I1 = nodes[c1].bounds.importance(p, n);
+            if(I0 + I1 <= 0)
+                return false;
+
+            float p0 = I0/(I0 + I1);
+            if(u < p0){
+                i = c0;
+                u = std::min(u/p0, 0.99999994f);
+                pmf *= p0;
+            }else{
+                i = c1;
+                u = std::min((u - p0)/(1 - p0), 0.99999994f);
+                pmf *= 1 - p0;
+            }
+        }
+
+        const Emitter& E = emitters[nodes[i].emitter];
+        E.sample(u1, u2, s.position, s.Le);
+        s.normal = E.normal;
+        s.pdf = pmf/E.area;
+        s.emitter = nodes[i].emitter;
+        return true;
+    }
+
+    private:
+    int build(std::vector<int>& index, int b, int e){
+        int i = nodes.size();
+        nodes.emplace_back();
+
+        if(e - b == 1){
+            nodes[i].emitter = index[b];
+            nodes[i].bounds = LightBounds{emitters[index[b]]};
+            return i;
+        }
+
+        // divide pela mediana dos centróides no maior eixo
+        BoundingBox centroids;
+        for(int k = b; k < e; k++)
+            centroids.add(centroid(emitters[index[k]]));
+
+        vec3 ext = centroids.max() - centroids.min();
+        int axis = 0;
+        if(ext[1] > ext[axis]) axis = 1;
+        if(ext[2] > ext[axis]) axis = 2;
+
+        int m = (b + e)/2;
+        std::nth_element(index.begin()+b, index.begin()+m, index.begin()+e,
+            [&](int i0, int i1){
+                return centroid(emitters[i0])[axis] < centroid(emitters[i1])[axis];
+            }
+        );
+
+        build(index, b, m);
+        int c1 = build(index, m, e);
+
+        nodes[i].child = c1;
+        nodes[i].bounds = merge(nodes[i+1].bounds, nodes[c1].bounds);
+        return i;
+    }
+
+    static vec3 centroid(const Emitter& E){
+        return (1.0f/3)*(E.tri[0].position + E.tri[1].position + E.tri[2].position);
+    }
+};
+
+#endif
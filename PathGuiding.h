@@ -0,0 +1,128 @@
+#ifndef PATH_GUIDING_H
+#define PATH_GUIDING_H
+
+#include "vec.h"
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+// Distribuição de radiância incidente aprendida durante a renderização.
+// O espaço é dividido em uma grade de células (endereçadas por hash, sem
+// tratar colisões) e cada célula guarda um histograma de direções sobre
+// a esfera, com faixas iguais em z e em phi (bins de mesmo ângulo sólido).
+//
+// record() acumula amostras da passada atual; update() transforma o que
+// foi aprendido na distribuição usada por sample() e pdf() na próxima passada.
+class GuidingField{
+    static const int NZ = 8;
+    static const int NPHI = 16;
+    static const int NBINS = NZ*NPHI;
+
+    float cell_size = 0;
+    uint64_t mask = 0;
+    std::vector<float> learn;   // histogramas da passada atual
+    std::vector<float> cdf;     // distribuições acumuladas já aprendidas
+
+    public:
+    GuidingField() = default;
+
+    GuidingField(float cell_size, int log2_cells = 14) :
+        cell_size{cell_size},
+        mask{(uint64_t{1} << log2_cells) - 1},
+        learn((mask+1)*NBINS, 0.0f),
+        cdf((mask+1)*NBINS, 0.0f)
+    {}
+
+    bool enabled() const{ return !learn.empty(); }
+
+    // Há distribuição aprendida na célula de p?
+    bool trained(vec3 p) const{
+        return enabled() && cdf[cell(p)*NBINS + NBINS-1] > 0;
+    }
+
+    // Registra a radiância L que chega em p pela direção dir, amostrada com densidade pdf
+    void record(vec3 p, vec3 dir, vec3 L, float pdf){
+        if(!enabled() || pdf <= 0)
+            return;
+
+        float v = (L[0] + L[1] + L[2])/(3*pdf);
+        if(!(v > 0))
+            return;
+
+        float& bin = learn[cell(p)*NBINS + bin_of(dir)];
+        #pragma omp atomic
+        bin += v;
+    }
+
+    // Fim de uma passada: as células com amostras novas trocam de distribuição
+    void update(){
+        if(!enabled())
+            return;
+
+        for(size_t c = 0; c <= mask; c++){
+            float* L = &learn[c*NBINS];
+            float total = 0;
+            for(int i = 0; i < NBINS; i++)
+                total += L[i];
+
+            if(total > 0){
+                // piso uniforme para não zerar direções ainda não vistas
+                float floor = 0.01f*total/NBINS;
+                float* C = &cdf[c*NBINS];
+                float sum = 0;
+                for(int i = 0; i < NBINS; i++){
+                    sum += L[i] + floor;
+                    C[i] = sum;
+                }
+                for(int i = 0; i < NBINS; i++)
+                    C[i] /= sum;
+            }
+            std::fill(L, L + NBINS, 0.0f);
+        }
+    }
+
+    // Amostra uma direção em uma célula treinada
+    vec3 sample(vec3 p, float u, float u1, float u2) const{
+        const float* C = &cdf[cell(p)*NBINS];
+        int b = std::upper_bound(C, C + NBINS, u) - C;
+        b = std::min(b, NBINS-1);
+
+        float z = -1 + 2*(b/NPHI + u1)/NZ;
+        float phi = 2*M_PI*(b%NPHI + u2)/NPHI;
+        float r = sqrt(std::max(0.0f, 1 - z*z));
+        return vec3{r*cosf(phi), r*sinf(phi), z};
+    }
+
+    // Densidade (em ângulo sólido) de sample() escolher dir
+    float pdf(vec3 p, vec3 dir) const{
+        const float* C = &cdf[cell(p)*NBINS];
+        int b = bin_of(dir);
+        float P = C[b] - (b > 0? C[b-1]: 0);
+        return P*NBINS/(4*M_PI);
+    }
+
+    private:
+    uint64_t cell(vec3 p) const{
+        int64_t i = (int64_t)floor(p[0]/cell_size);
+        int64_t j = (int64_t)floor(p[1]/cell_size);
+        int64_t k = (int64_t)floor(p[2]/cell_size);
+        uint64_t h = (uint64_t)i*73856093u ^ (uint64_t)j*19349663u ^ (uint64_t)k*83492791u;
+        return h & mask;
+    }
+
+    static int bin_of(vec3 dir){
+        float z = clamp_unit(dir[2]);
+        int iz = std::min(NZ-1, (int)((z + 1)/2*NZ));
+        float phi = atan2(dir[1], dir[0]);
+        if(phi < 0)
+            phi += 2*M_PI;
+        int ip = std::min(NPHI-1, (int)(phi/(2*M_PI)*NPHI));
+        return iz*NPHI + ip;
+    }
+
+    static float clamp_unit(float x){
+        return std::max(-1.0f, std::min(1.0f, x));
+    }
+};
+
+#endif
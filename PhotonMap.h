@@ -0,0 +1,120 @@
+#ifndef PHOTON_MAP_H
+#define PHOTON_MAP_H
+
+#include "vec.h"
+#include <vector>
+#include <algorithm>
+
+struct Photon{
+    vec3 position;
+    vec3 power;     // fluxo transportado
+    vec3 dir;       // direção de propagação ao chegar na superfície
+};
+
+// Árvore kd implícita: o nó de cada intervalo [b, e) é o elemento do meio,
+// o filho esquerdo é [b, m) e o direito é [m+1, e).
+class PhotonMap{
+    std::vector<Photon> photons;
+    std::vector<unsigned char> axes;
+
+    using Candidate = std::pair<float, int>;  // distância ao quadrado, índice
+
+    public:
+    PhotonMap() = default;
+
+    PhotonMap(std::vector<Photon> _photons) :
+        photons{std::move(_photons)}, axes(photons.size())
+    {
+        build(0, photons.size());
+    }
+
+    bool empty() const{ return photons.empty(); }
+    size_t size() const{ return photons.size(); }
+
+    // Densidade de fluxo (irradiância) em p, estimada pelos k fótons mais
+    // próximos dentro do raio max_radius que chegam pela frente da normal n.
+    vec3 irradiance(vec3 p, vec3 n, int k, float max_radius) const{
+        std::vector<Candidate> heap;
+        heap.reserve(k+1);
+        float r2 = max_radius*max_radius;
+        knn(0, photons.size(), p, k, r2, heap);
+
+        vec3 E = {0, 0, 0};
+        if(heap.empty())
+            return E;
+
+        for(Candidate c: heap){
+            const Photon& P = photons[c.second];
+            if(dot(P.dir, n) < 0)
+                E = E + P.power;
+        }
+        return (1/(M_PI*r2))*E;
+    }
+
+    private:
+    void build(int b, int e){
+        if(e - b <= 1)
+            return;
+
+        vec3 pmin = photons[b].position, pmax = pmin;
+        for(int i = b+1; i < e; i++){
+            for(int j = 0; j < 3; j++){
+                pmin[j] = std::min(pmin[j], photons[i].position[j]);
+                pmax[j] = std::max(pmax[j], photons[i].position[j]);
+            }
+        }
+
+        vec3 ext = pmax - pmin;
+        int axis = 0;
+        if(ext[1] > ext[axis]) axis = 1;
+        if(ext[2] > ext[axis]) axis = 2;
+
+        int m = (b + e)/2;
+        std::nth_element(photons.begin()+b, photons.begin()+m, photons.begin()+e,
+            [axis](const Photon& P, const Photon& Q){
+                return P.position[axis] < Q.position[axis];
+            }
+        );
+        axes[m] = axis;
+
+        build(b, m);
+        build(m+1, e);
+    }
+
+    // k vizinhos mais próximos; r2 encolhe para a distância do k-ésimo
+    void knn(int b, int e, vec3 p, int k, float& r2, std::vector<Candidate>& heap) const{
+        if(b >= e)
+            return;
+
+        int m = (b + e)/2;
+        const Photon& P = photons[m];
+        float d = p[axes[m]] - P.position[axes[m]];
+
+        if(e - b > 1){
+            if(d < 0){
+                knn(b, m, p, k, r2, heap);
+                if(d*d < r2)
+                    knn(m+1, e, p, k, r2, heap);
+            }else{
+                knn(m+1, e, p, k, r2, heap);
+                if(d*d < r2)
+                    knn(b, m, p, k, r2, heap);
+            }
+        }
+
+        float dist2 = norm2(p - P.position);
+        if(dist2 >= r2)
+            return;
+
+        heap.push_back({dist2, m});
+        std::push_heap(heap.begin(), heap.end());
+        if((int)heap.size() > k){
+            std::pop_heap(heap.begin(), heap.end());
+            heap.pop_back();
+        }
+        if((int)heap.size() == k)
+            r2 = heap.front().first;
+    }
+};
+
+#endif
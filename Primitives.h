@@ -15,6 +15,15 @@ auto assemble(const Prims& P, const Cont& V)
 	return res;
 }
 
+// Sequência 0, 1, ..., n-1: montar primitivas sobre ela dá os índices
+// dos vértices de cada uma (Line<unsigned int> ou Triangle<unsigned int>)
+inline std::vector<unsigned int> identity_indices(size_t n){
+	std::vector<unsigned int> seq(n);
+	for(unsigned int i = 0; i < n; i++)
+		seq[i] = i;
+	return seq;
+}
+
 ///////////////////////////////////////////////////////////////////////
 template<class V>
 using Line = std::array<V, 2>;
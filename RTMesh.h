@@ -92,6 +92,9 @@ class MeshRange{
 
         return res;
     }
+
+    const MaterialInfo& get_material() const{ return material; }
+    const std::vector<ObjTriangle>& get_triangles() const{ return triangles; }
 };
 
 /******************************* TEXTURE MANAGEMENT ********************************/
@@ -171,6 +174,10 @@ class RTMesh{
         bounding_volume = BoundingVolume{mesh.position};
     }
 
+    const std::vector<MeshRange>& get_ranges() const{ return mesh_ranges; }
+    mat4 get_model_matrix() const{ return M; }
+    mat3 get_normal_matrix() const{ return MN; }
+
     MatTriIntersection min_intersection(Ray ray)const{
         MatTriIntersection min_intersection;
         min_intersection.t = HUGE_VALF;
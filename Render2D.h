@@ -10,36 +10,82 @@
 
 struct Render2dPipeline{
 	ImageRGB& image;
+	bool antialiased = false;   // linhas com o algoritmo de Wu, misturadas na imagem
 
 	template<class Vertices, class Prims>
 	void run(const Vertices& V, const Prims& P){
 		ClipRectangle R = {-0.5f, -0.5f, image.width()-0.5f, image.height()-0.5f};
-		for(auto primitive: clip(assemble(P, V), R))
-			draw(primitive);
+		for(unsigned int i = 0; i < P.size(); i++)
+			clip(P.assemble(i, std::data(V)), R, [&](const auto& primitive){ draw(primitive); });
 	}
 
-	void paint(Pixel p, RGB c){
-		if(p.x >= 0 && p.y >= 0 && p.x < image.width() && p.y < image.height())
-			image(p.x,p.y) = c;
+	Scissor bounds() const{
+		return {0, 0, image.width(), image.height()};
 	}
 
 	void draw(Line<Vec2Col> line){
 		vec2 L[] = { line[0].position, line[1].position };
-		RGB  C[] = { line[0].color,    line[1].color    };
+		vec3 C[] = { toVec(line[0].color), toVec(line[1].color) };
+		vec3 dC = C[1] - C[0];
 
-		for(Pixel p: rasterizeLine(L)){
-			float t = find_mix_param(toVec2(p), L[0], L[1]);
-			RGB color = lerp(t, C[0], C[1]);
-			paint(p, color);
-		};
+		if(antialiased){
+			rasterizeLineAA(L[0], L[1], bounds(), [&](Pixel p, float t, float coverage){
+				RGB& dst = image(p.x, p.y);
+				vec3 c = C[0] + t*dC;
+				dst = toColor(toVec(dst) + coverage*(c - toVec(dst)));
+			});
+		}else{
+			rasterizeLineSpan(L[0], L[1], bounds(), [&](Pixel p, float t){
+				image(p.x, p.y) = toColor(C[0] + t*dC);
+			});
+		}
 	}
 
+	// Preenchimento por trechos horizontais (scanline, já recortados pela
+	// imagem), com a cor interpolada em ponto fixo 16.16: o valor no início
+	// de cada linha anda por dC/dy, e ao longo do trecho por dC/dx.
+	// Triângulos de área nula recebem a média das cores.
 	void draw(Triangle<Vec2Col> tri){
-        // TAREFA - AULA 09
-        // Para cada pixel da rasterização
-        // calcule as coordenadas baricêntricas
-        // use essas coordenadas para interpolar as cores
-        // pinte o pixel com a cor interpolada
+		vec2 P[] = { tri[0].position, tri[1].position, tri[2].position };
+		double ux = P[1][0] - P[0][0], uy = P[1][1] - P[0][1];
+		double vx = P[2][0] - P[0][0], vy = P[2][1] - P[0][1];
+		double area = ux*vy - uy*vx;
+
+		int64_t row[3], dx[3], dy[3];
+		for(int k = 0; k < 3; k++){
+			double c = tri[0].color[k];
+			double du = tri[1].color[k] - c;
+			double dv = tri[2].color[k] - c;
+			double gx = 0, gy = 0;
+			if(area != 0){
+				gx = (du*vy - dv*uy)/area;
+				gy = (dv*ux - du*vx)/area;
+			}else{
+				c = (c + tri[1].color[k] + tri[2].color[k])/3;
+			}
+			// valor em (0, 0), com 0.5 para arredondar no deslocamento
+			row[k] = llround((c - gx*P[0][0] - gy*P[0][1] + 0.5)*65536);
+			dx[k] = llround(gx*65536);
+			dy[k] = llround(gy*65536);
+		}
+
+		int ylast = 0;
+		scanline(P, bounds(), [&](int y, int x0, int x1){
+			int64_t c[3];
+			for(int k = 0; k < 3; k++){
+				row[k] += (y - ylast)*dy[k];
+				c[k] = row[k] + x0*dx[k];
+			}
+			ylast = y;
+
+			RGB* out = &image(x0, y);
+			for(int x = x0; x < x1; x++, out++){
+				for(int k = 0; k < 3; k++){
+					(*out)[k] = (Byte)std::clamp<int64_t>(c[k] >> 16, 0, 255);
+					c[k] += dx[k];
+				}
+			}
+		});
 	}
 };
 
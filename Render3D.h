@@ -1,55 +1,647 @@
 #pragma once
 
 #include <vector>
+#include <type_traits>
+#include <climits>
 #include "geometry.h"
 #include "Image.h"
 #include "Primitives.h"
 #include "rasterization.h"
 #include "Clip3D.h"
+#include "VaryingUtils.h"
 
-template<class Shader, class ImageType>
+// Equações de plano de um triângulo na tela, com origem em T[0]:
+// f(x, y) = f0 + (x - T[0].x)*fdx + (y - T[0].y)*fdy
+struct TriangleSetup{
+	vec2 T[3];
+	float iw[3];                // 1/w nos vértices
+	float gx[3], gy[3];         // gradientes das coordenadas baricêntricas
+	float Z0, Zdx, Zdy, zmin;   // plano de z/w e seu mínimo no triângulo
+	float W0, Wdx, Wdy;         // plano de 1/w
+
+	// P: vértices em coordenadas de recorte; T0, T1, T2: na tela.
+	// Retorna false se o triângulo tiver área nula na tela.
+	bool init(const vec4* P, vec2 T0, vec2 T1, vec2 T2){
+		T[0] = T0; 
+		T[1] = T1; 
+		T[2] = T2;
+
+		vec2 d1 = T[1] - T[0];
+		vec2 d2 = T[2] - T[0];
+		float det = d1[0]*d2[1] - d1[1]*d2[0];
+		if(det == 0)
+			return false;
+
+		gx[1] =  d2[1]/det;
+		gx[2] = -d1[1]/det;
+		gy[1] = -d2[0]/det;
+		gy[2] =  d1[0]/det;
+		gx[0] = -gx[1] - gx[2];
+		gy[0] = -gy[1] - gy[2];
+
+		for(int i = 0; i < 3; i++)
+			iw[i] = 1/P[i][3];
+
+		float z[] = {P[0][2]*iw[0], P[1][2]*iw[1], P[2][2]*iw[2]};
+		Z0 = z[0];
+		Zdx = z[0]*gx[0] + z[1]*gx[1] + z[2]*gx[2];
+		Zdy = z[0]*gy[0] + z[1]*gy[1] + z[2]*gy[2];
+		zmin = std::min({z[0], z[1], z[2]});
+
+		W0 = iw[0];
+		Wdx = iw[0]*gx[0] + iw[1]*gx[1] + iw[2]*gx[2];
+		Wdy = iw[0]*gy[0] + iw[1]*gy[1] + iw[2]*gy[2];
+		return true;
+	}
+
+	// Plano de a/w, dados os valores de a nos vértices (a pode ser um Varying).
+	// Sem correção perspectiva, o plano é o do próprio a.
+	template<bool Perspective = true, class Attr>
+	void plane(const Attr& a0, const Attr& a1, const Attr& a2, Attr& f0, Attr& fdx, Attr& fdy) const{
+		float k[] = {1, 1, 1};
+		if constexpr(Perspective)
+			std::copy(iw, iw + 3, k);
+		f0  = varying_scale(k[0], a0);
+		fdx = varying_combine(k[0]*gx[0], a0, k[1]*gx[1], a1, k[2]*gx[2], a2);
+		fdy = varying_combine(k[0]*gy[0], a0, k[1]*gy[1], a1, k[2]*gy[2], a2);
+	}
+
+	// Limite inferior de z/w no bloco 8x8 com canto em (bx, by)
+	float block_zmin(int bx, int by) const{
+		float qx = bx - T[0][0];
+		float qy = by - T[0][1];
+		float zb = Z0 + qx*Zdx + qy*Zdy + std::min(0.0f, 7*Zdx) + std::min(0.0f, 7*Zdy);
+		return std::max(zb, zmin);
+	}
+};
+
+// Um shader pode oferecer, além de fragmentShader, a versão para quads 2x2
+//   void fragmentShader4(const Varying (&V)[4], unsigned int mask, RGB (&FragColor)[4])
+// que recebe os atributos dos 4 pixels do quad (índice dx + 2*dy) de uma vez.
+// Só os pixels com bit ligado em mask são escritos; os demais estão fora do
+// triângulo e servem para derivadas, como ddx = V[1] - V[0] e ddy = V[2] - V[0].
+template<class Shader, class = void>
+struct has_quad_shader : std::false_type{};
+
+template<class Shader>
+struct has_quad_shader<Shader, std::void_t<decltype(std::declval<Shader&>().fragmentShader4(
+	std::declval<const typename Shader::Varying (&)[4]>(), 0u, std::declval<RGB (&)[4]>()))>> : std::true_type{};
+
+// Imagens com várias amostras por pixel (ver ImageZBufferMSAA) são
+// desenhadas pelo caminho de MSAA do pipeline
+template<class ImageType>
+struct is_multisample : std::false_type{};
+
+enum CullMode{ CULL_NONE, CULL_BACK, CULL_FRONT, CULL_DYNAMIC };
+enum FrontFace{ FRONT_CCW, FRONT_CW };
+enum ClipMode{ CLIP_FULL, CLIP_GUARD_BAND, CLIP_NONE };
+enum BlendMode{ BLEND_REPLACE, BLEND_ADD };
+
+// Opções do pipeline fixadas em tempo de compilação: cada combinação gera
+// seu próprio laço interno, sem os testes das etapas desligadas.
+//  Depth:       teste de profundidade da imagem (testDepth/testBlock)
+//  Perspective: interpolação com correção perspectiva; sem ela, linear na tela
+//  Clip:        recorte só nos planos cruzados, com banda de guarda, ou
+//               nenhum (a geometria deve estar toda na frente da câmera)
+//  Blend:       o fragmento substitui ou é somado (com saturação) à cor da imagem
+//  Cull:        modo fixo, ou CULL_DYNAMIC para usar o membro cull do pipeline
+template<bool Depth = true, bool Perspective = true, ClipMode Clip = CLIP_GUARD_BAND, 
+         BlendMode Blend = BLEND_REPLACE, CullMode Cull = CULL_DYNAMIC>
+struct PipelinePolicy{
+	static constexpr bool depth = Depth;
+	static constexpr bool perspective = Perspective;
+	static constexpr ClipMode clip = Clip;
+	static constexpr BlendMode blend = Blend;
+	static constexpr CullMode cull = Cull;
+};
+
+using DefaultPolicy = PipelinePolicy<>;
+
+template<class Shader, class ImageType, class Policy = DefaultPolicy>
 struct RenderPipeline{
 	using Varying = typename Shader::Varying;
 
 	Shader& shader;
 	ImageType& image;
+	CullMode cull = CULL_NONE;
+	FrontFace front_face = FRONT_CCW;   // orientação da face da frente nas coordenadas normalizadas
 	
+	// Vértices transformados, referenciados pelas primitivas por índice.
+	// O shader de vértice roda só nos vértices usados, uma vez em cada;
+	// os vértices criados pelo recorte vão para extra, com índices a partir de n.
+	struct VertexCache{
+		std::vector<Varying> PV;
+		std::vector<unsigned char> done;
+		std::vector<Varying> extra;
+
+		VertexCache(size_t n = 0): PV(n), done(n, 0){}
+
+		const Varying& operator[](unsigned int i) const{
+			return i < PV.size()? PV[i]: extra[i - PV.size()];
+		}
+
+		unsigned int add(const Varying& v){
+			extra.push_back(v);
+			return PV.size() + extra.size() - 1;
+		}
+	};
+
 	template<class VertexAttrib, class Prims>
 	void run(const VertexAttrib& V, const Prims& p){
-		for(auto primitive: clip(assemble(p, transform(V)))) 
-			draw(primitive);
+		VertexCache cache{std::size(V)};
+		std::vector<unsigned int> seq = identity_indices(std::size(V));
+
+		for(unsigned int i = 0; i < p.size(); i++){
+			auto prim = p.assemble(i, seq.data());
+			fetch(V, cache, prim);
+			cull_clip(cache, prim, [&](const auto& q){ draw(cache, q); });
+		}
+	}
+
+	// Modo em blocos: os triângulos são distribuídos nos tiles da tela que
+	// tocam e cada tile é desenhado por uma thread, com os triângulos na
+	// ordem de submissão. Cada pixel pertence a um só tile, então não há
+	// escrita compartilhada e o resultado é igual ao de run().
+	// O tamanho do tile é arredondado para múltiplo de 8, o passo em que
+	// draw(Triangle) reancora a interpolação.
+	template<class VertexAttrib, class Prims>
+	void run_binned(const VertexAttrib& V, const Prims& p, int tile_size = 64){
+		VertexCache cache{std::size(V)};
+		std::vector<unsigned int> seq = identity_indices(std::size(V));
+
+		run_binned(V, cache, seq, p, tile_size);
+	}
+
+	// Várias faixas de primitivas sobre os mesmos vértices (por exemplo, uma
+	// por material de uma malha). O cache de vértices transformados é
+	// compartilhado entre as faixas, e setup(k) ajusta o estado do shader
+	// (textura, cores) antes da faixa k; o shader de vértice não pode
+	// depender desse estado.
+	template<class VertexAttrib, class Ranges, class Setup>
+	void run_ranges(const VertexAttrib& V, const Ranges& ranges, Setup setup){
+		VertexCache cache{std::size(V)};
+		std::vector<unsigned int> seq = identity_indices(std::size(V));
+
+		for(unsigned int k = 0; k < std::size(ranges); k++){
+			setup(k);
+			const auto& p = ranges[k];
+			for(unsigned int i = 0; i < p.size(); i++){
+				auto prim = p.assemble(i, seq.data());
+				fetch(V, cache, prim);
+				cull_clip(cache, prim, [&](const auto& q){ draw(cache, q); });
+			}
+		}
+	}
+
+	template<class VertexAttrib, class Ranges, class Setup>
+	void run_ranges_binned(const VertexAttrib& V, const Ranges& ranges, Setup setup, int tile_size = 64){
+		VertexCache cache{std::size(V)};
+		std::vector<unsigned int> seq = identity_indices(std::size(V));
+
+		for(unsigned int k = 0; k < std::size(ranges); k++){
+			setup(k);
+			run_binned(V, cache, seq, ranges[k], tile_size);
+		}
+	}
+
+	template<class VertexAttrib, class Prims>
+	void run_binned(const VertexAttrib& V, VertexCache& cache, const std::vector<unsigned int>& seq, const Prims& p, int tile_size){
+		std::vector<Triangle<unsigned int>> tris;
+		std::vector<Line<Varying>> lines;
+		for(unsigned int i = 0; i < p.size(); i++){
+			auto prim = p.assemble(i, seq.data());
+			fetch(V, cache, prim);
+			cull_clip(cache, prim, [&](const auto& q){
+				if constexpr(std::is_same_v<std::decay_t<decltype(q)>, Line<Varying>>)
+					lines.push_back(q);
+				else
+					tris.push_back(q);
+			});
+		}
+
+		draw_binned(cache, tris, (std::max(tile_size, 1) + 7) & ~7);
+
+		// Linhas não são divididas em tiles
+		for(const Line<Varying>& line: lines)
+			draw(line);
+	}
+
+	// Modo adiado (visibility buffer): a primeira passada só rasteriza e
+	// testa a profundidade, guardando em cada pixel o triângulo visível e
+	// suas coordenadas baricêntricas; a segunda interpola os atributos e
+	// roda o shader de fragmento uma única vez por pixel visível, qualquer
+	// que seja a sobreposição. Linhas são desenhadas direto.
+	template<class VertexAttrib, class Prims>
+	void run_deferred(const VertexAttrib& V, const Prims& p){
+		VertexCache cache{std::size(V)};
+		std::vector<unsigned int> seq = identity_indices(std::size(V));
+
+		Image<VisibilitySample> vis{image.width(), image.height()};
+		vis.fill({NO_TRIANGLE, 0, 0});
+
+		std::vector<Triangle<unsigned int>> tris;
+		for(unsigned int i = 0; i < p.size(); i++){
+			auto prim = p.assemble(i, seq.data());
+			fetch(V, cache, prim);
+			cull_clip(cache, prim, [&](const auto& q){
+				if constexpr(std::is_same_v<std::decay_t<decltype(q)>, Line<Varying>>){
+					draw(q);
+				}else{
+					tris.push_back(q);
+					draw_visibility(cache, q, tris.size()-1, vis);
+				}
+			});
+		}
+
+		#pragma omp parallel for schedule(dynamic, 1)
+		for(int y = 0; y < vis.height(); y++)
+			for(int x = 0; x < vis.width(); x++){
+				VisibilitySample s = vis(x, y);
+				if(s.id == NO_TRIANGLE)
+					continue;
+
+				const Triangle<unsigned int>& tri = tris[s.id];
+				Varying v = varying_combine(1 - s.b1 - s.b2, cache[tri[0]], s.b1, cache[tri[1]], s.b2, cache[tri[2]]);
+				shade(x, y, v);
+			}
 	}
 
-	template<class VertexAttrib>
-	std::vector<Varying> transform(const VertexAttrib& V){
-		std::vector<Varying> PV(std::size(V)); // requires c++17!
-		for(unsigned int i = 0; i < std::size(V); i++)
-			shader.vertexShader(V[i], PV[i]);
-		return PV;
+	static const unsigned int NO_TRIANGLE = UINT_MAX;
+
+	struct VisibilitySample{
+		unsigned int id;   // índice do triângulo visível
+		float b1, b2;      // coordenadas baricêntricas (já com correção perspectiva)
+	};
+
+	// Roda o shader de vértice nos vértices da primitiva ainda não transformados
+	template<class VertexAttrib, class Prim>
+	void fetch(const VertexAttrib& V, VertexCache& cache, const Prim& prim){
+		for(unsigned int i: prim)
+			if(!cache.done[i]){
+				shader.vertexShader(V[i], cache.PV[i]);
+				cache.done[i] = 1;
+			}
+	}
+
+	// Descarte antes do recorte: triângulos de costas (conforme cull) ou de
+	// área nula são descartados, os totalmente fora de algum plano do volume
+	// de visão também, e os que estão dentro da banda de guarda vão direto
+	// para emit. Os demais são recortados só pelos planos que cruzam (near,
+	// far e as bordas da banda de guarda); o que sobra fora da tela é
+	// descartado pelo scissor do rasterizador.
+	template<class Emit>
+	void cull_clip(VertexCache& cache, const Triangle<unsigned int>& tri, Emit emit){
+		vec4 P[] = { getPosition(cache[tri[0]]), getPosition(cache[tri[1]]), getPosition(cache[tri[2]]) };
+		if(culled(P))
+			return;
+
+		unsigned int c[] = { outcode(P[0]), outcode(P[1]), outcode(P[2]) };
+		if(c[0] & c[1] & c[2])
+			return;
+
+		std::array<vec4, 6> G = normals();
+		unsigned int g = c[0] | c[1] | c[2];
+		if constexpr(Policy::clip == CLIP_GUARD_BAND){
+			G = guard_band_normals();
+			g = outcode(P[0], G) | outcode(P[1], G) | outcode(P[2], G);
+		}
+		if(g == 0 || Policy::clip == CLIP_NONE){
+			emit(tri);
+			return;
+		}
+
+		ClipPolygon<Varying> polygon;
+		if(!clip(Triangle<Varying>{cache[tri[0]], cache[tri[1]], cache[tri[2]]}, polygon, g, G))
+			return;
+
+		unsigned int first = cache.add(polygon.v[0]);
+		for(int i = 1; i < polygon.n; i++)
+			cache.add(polygon.v[i]);
+
+		for(int i = 1; i+1 < polygon.n; i++)
+			emit(Triangle<unsigned int>{first, first + i, first + i + 1});
+	}
+
+	template<class Emit>
+	void cull_clip(VertexCache& cache, const Line<unsigned int>& l, Emit emit){
+		Line<Varying> line = {cache[l[0]], cache[l[1]]};
+		if(Policy::clip == CLIP_NONE || clip(line))
+			emit(line);
+	}
+
+	// A orientação na tela é o sinal de det[x y w] dos vértices em coordenadas
+	// homogêneas, o que vale mesmo antes do recorte (Olano e Greer, 1997)
+	bool culled(const vec4* P) const{
+		float det = 
+			P[0][0]*(P[1][1]*P[2][3] - P[2][1]*P[1][3]) -
+			P[0][1]*(P[1][0]*P[2][3] - P[2][0]*P[1][3]) +
+			P[0][3]*(P[1][0]*P[2][1] - P[2][0]*P[1][1]);
+
+		if(det == 0)
+			return true;
+
+		CullMode mode = (Policy::cull == CULL_DYNAMIC)? cull: Policy::cull;
+		if(mode != CULL_BACK && mode != CULL_FRONT)
+			return false;
+
+		bool front = (det > 0) == (front_face == FRONT_CCW);
+		return (mode == CULL_BACK)? !front: front;
 	}
 
 	void draw(Line<Varying> line){
 		vec4 P[] = { getPosition(line[0]), getPosition(line[1]) };
 		vec2 L[] = { toScreen(P[0]), toScreen(P[1]) };
 			
-		for(Pixel p: rasterizeLine(L)){
-			float t = find_mix_param(toVec2(p), L[0], L[1]);
-			Varying vi = (1-t)*line[0] + t*line[1];
+		rasterizeLineSpan(L[0], L[1], Scissor{0, 0, image.width(), image.height()}, [&](Pixel p, float t){
+			Varying vi = varying_lerp(t, line[0], line[1]);
 			paint(p, vi);
-		}
+		});
 	}
 	
-	void draw(Triangle<Varying> tri){
-		vec4 P[] = { getPosition(tri[0]), getPosition(tri[1]), getPosition(tri[2]) };
-		vec2 T[] = { toScreen(P[0]), toScreen(P[1]), toScreen(P[2]) };
-		vec3 iw =  {1/P[0][3], 1/P[1][3], 1/P[2][3]};
-		for(Pixel p: rasterizeTriangle(T)){
-			vec3 t = barycentric_coords(toVec2(p), T);
-			t=t*iw;
-			t=1.0/(t[0]+t[1]+t[2])*t;
-
-			Varying vi = t[0]*tri[0] + t[1]*tri[1] + t[2]*tri[2];
-			paint(p, vi);
+	// Distribui os triângulos nos tiles (tile_size x tile_size, em ordem de
+	// linhas) que a caixa envolvente de cada um toca, na ordem de submissão
+	std::vector<std::vector<unsigned int>> bin_triangles(const VertexCache& cache, const std::vector<Triangle<unsigned int>>& tris, int tile_size){
+		int w = image.width();
+		int h = image.height();
+		int ntx = (w + tile_size - 1)/tile_size;
+		int nty = (h + tile_size - 1)/tile_size;
+
+		std::vector<std::vector<unsigned int>> bins(ntx*nty);
+		for(unsigned int i = 0; i < tris.size(); i++){
+			vec2 T[] = { 
+				toScreen(getPosition(cache[tris[i][0]])), 
+				toScreen(getPosition(cache[tris[i][1]])), 
+				toScreen(getPosition(cache[tris[i][2]]))
+			};
+			int xmin = std::max(0,    (int) ceil(std::min({T[0][0], T[1][0], T[2][0]})));
+			int xmax = std::min(w-1, (int)floor(std::max({T[0][0], T[1][0], T[2][0]})));
+			int ymin = std::max(0,    (int) ceil(std::min({T[0][1], T[1][1], T[2][1]})));
+			int ymax = std::min(h-1, (int)floor(std::max({T[0][1], T[1][1], T[2][1]})));
+
+			for(int ty = ymin/tile_size; ty <= ymax/tile_size && ymin <= ymax; ty++)
+				for(int tx = xmin/tile_size; tx <= xmax/tile_size && xmin <= xmax; tx++)
+					bins[ty*ntx + tx].push_back(i);
+		}
+		return bins;
+	}
+
+	void draw_binned(const VertexCache& cache, const std::vector<Triangle<unsigned int>>& tris, int tile_size){
+		int w = image.width();
+		int h = image.height();
+		int ntx = (w + tile_size - 1)/tile_size;
+		int nty = (h + tile_size - 1)/tile_size;
+
+		std::vector<std::vector<unsigned int>> bins = bin_triangles(cache, tris, tile_size);
+
+		#pragma omp parallel for schedule(dynamic, 1)
+		for(int b = 0; b < ntx*nty; b++){
+			int x0 = (b%ntx)*tile_size;
+			int y0 = (b/ntx)*tile_size;
+			Scissor S{x0, y0, std::min(x0 + tile_size, w), std::min(y0 + tile_size, h)};
+			for(unsigned int i: bins[b])
+				draw(cache[tris[i][0]], cache[tris[i][1]], cache[tris[i][2]], S);
+		}
+	}
+
+	void draw(const VertexCache&, const Line<Varying>& line){
+		draw(line);
+	}
+
+	void draw(const VertexCache& cache, const Triangle<unsigned int>& tri){
+		draw(cache[tri[0]], cache[tri[1]], cache[tri[2]], Scissor{0, 0, image.width(), image.height()});
+	}
+
+	void draw(const Triangle<Varying>& tri){
+		draw(tri[0], tri[1], tri[2], Scissor{0, 0, image.width(), image.height()});
+	}
+
+	void draw(const Varying& A, const Varying& B, const Varying& C, Scissor S){
+		vec4 P[] = { getPosition(A), getPosition(B), getPosition(C) };
+		TriangleSetup ts;
+		if(!ts.init(P, toScreen(P[0]), toScreen(P[1]), toScreen(P[2])))
+			return;
+
+		if constexpr(std::is_same_v<ImageType, Image<float>>){
+			drawDepth(ts, S);
+		}else{
+			Varying V0, Vdx, Vdy;
+			ts.plane<Policy::perspective>(A, B, C, V0, Vdx, Vdy);
+
+			if constexpr(is_multisample<ImageType>::value)
+				drawMultisample(ts, V0, Vdx, Vdy, S);
+			else if constexpr(has_quad_shader<Shader>::value)
+				drawQuads(ts, V0, Vdx, Vdy, S);
+			else
+				drawSpans(ts, V0, Vdx, Vdy, S);
+		}
+	}
+
+	// Passada só de profundidade numa Image<float>: nenhum atributo é
+	// interpolado e cada pixel guarda o menor z/w
+	void drawDepth(const TriangleSetup& ts, Scissor S){
+		rasterizeTriangleSpans(ts.T, S, [&](int y, int x0, int x1){
+			float Zrow = ts.Z0 + (y - ts.T[0][1])*ts.Zdy - ts.T[0][0]*ts.Zdx;
+			float* row = &image(0, y);
+			for(int x = x0; x < x1; x++)
+				row[x] = std::min(row[x], Zrow + x*ts.Zdx);
+		});
+	}
+
+	// Sombreamento pixel a pixel, em trechos horizontais
+	void drawSpans(const TriangleSetup& ts, const Varying& V0, const Varying& Vdx, const Varying& Vdy, Scissor S){
+		rasterizeSpans(ts, S, [&](int y, int x0, int x1){
+			float qy = y - ts.T[0][1];
+			Varying Vrow = varying_madd(V0, qy, Vdy);
+			float Wrow = ts.W0 + qy*ts.Wdy;
+			float Zrow = ts.Z0 + qy*ts.Zdy;
+
+			// avança de pixel em pixel, reancorando no plano a cada 8 pixels
+			// para que o resultado não dependa de onde o trecho começa
+			Varying Vw;
+			float W = 0, Z = 0;
+			for(int x = x0; x < x1; x++){
+				if(x == x0 || (x & 7) == 0){
+					float qx = x - ts.T[0][0];
+					Vw = varying_madd(Vrow, qx, Vdx);
+					W = Wrow + qx*ts.Wdx;
+					Z = Zrow + qx*ts.Zdx;
+				}
+				// profundidade testada antes de interpolar os atributos
+				if(depthTest(x, y, Z)){
+					if constexpr(Policy::perspective)
+						shade(x, y, varying_scale(1/W, Vw));
+					else
+						shade(x, y, Vw);
+				}
+				Vw = varying_madd(Vw, 1.0f, Vdx);
+				W += ts.Wdx;
+				Z += ts.Zdx;
+			}
+		});
+	}
+
+	// Sombreamento em quads 2x2 alinhados. Os atributos são avaliados nos 4
+	// pixels do quad, mesmo nos que estão fora do triângulo, para que o
+	// shader tenha as derivadas na tela.
+	void drawQuads(const TriangleSetup& ts, const Varying& V0, const Varying& Vdx, const Varying& Vdy, Scissor S){
+		rasterizeQuads(ts, S, [&](int x, int y, unsigned int mask){
+			float qx = x - ts.T[0][0];
+			float qy = y - ts.T[0][1];
+
+			float Z = ts.Z0 + qx*ts.Zdx + qy*ts.Zdy;
+			for(int i = 0; i < 4; i++)
+				if((mask >> i & 1) && !depthTest(x + (i&1), y + (i>>1), Z + (i&1)*ts.Zdx + (i>>1)*ts.Zdy))
+					mask &= ~(1u << i);
+			if(mask == 0)
+				return;
+
+			Varying V[4];
+			V[0] = varying_madd(varying_madd(V0, qx, Vdx), qy, Vdy);
+			V[1] = varying_madd(V[0], 1.0f, Vdx);
+			V[2] = varying_madd(V[0], 1.0f, Vdy);
+			V[3] = varying_madd(V[1], 1.0f, Vdy);
+			if constexpr(Policy::perspective){
+				float W = ts.W0 + qx*ts.Wdx + qy*ts.Wdy;
+				float Wq[] = {W, W + ts.Wdx, W + ts.Wdy, W + ts.Wdx + ts.Wdy};
+				for(int i = 0; i < 4; i++)
+					V[i] = varying_scale(1/Wq[i], V[i]);
+			}
+
+			RGB color[4];
+			shader.fragmentShader4(V, mask, color);
+			for(int i = 0; i < 4; i++)
+				if(mask >> i & 1)
+					blend(x + (i&1), y + (i>>1), color[i]);
+		});
+	}
+
+	// MSAA: cobertura e profundidade por amostra, mas o shader roda uma vez
+	// por pixel, com os atributos no centro, e a cor vai para as amostras
+	// cobertas que passaram no teste de profundidade
+	void drawMultisample(const TriangleSetup& ts, const Varying& V0, const Varying& Vdx, const Varying& Vdy, Scissor S){
+		int n = image.samples();
+		auto offsets = image.sample_offsets();
+		edge_rasterize_samples(ts.T, S, offsets, n, [&](int x, int y, unsigned int mask){
+			float qx = x - ts.T[0][0];
+			float qy = y - ts.T[0][1];
+			if constexpr(Policy::depth){
+				float Zc = ts.Z0 + qx*ts.Zdx + qy*ts.Zdy;
+				float z[32];
+				for(int s = 0; s < n; s++)
+					z[s] = Zc + (offsets[s][0]*ts.Zdx + offsets[s][1]*ts.Zdy)/16;
+				mask = image.testSamples(x, y, z, mask);
+				if(mask == 0)
+					return;
+			}
+
+			Varying v = varying_madd(varying_madd(V0, qx, Vdx), qy, Vdy);
+			if constexpr(Policy::perspective)
+				v = varying_scale(1/(ts.W0 + qx*ts.Wdx + qy*ts.Wdy), v);
+
+			RGB color;
+			shader.fragmentShader(v, color);
+			for(int s = 0; s < n; s++)
+				if(mask >> s & 1)
+					blend(image.sample(x, y, s), color);
+		});
+	}
+
+	// Primeira passada do modo adiado: só profundidade e baricêntricas
+	void draw_visibility(const VertexCache& cache, const Triangle<unsigned int>& tri, unsigned int id, Image<VisibilitySample>& vis){
+		vec4 P[] = { getPosition(cache[tri[0]]), getPosition(cache[tri[1]]), getPosition(cache[tri[2]]) };
+		TriangleSetup ts;
+		if(!ts.init(P, toScreen(P[0]), toScreen(P[1]), toScreen(P[2])))
+			return;
+
+		// planos de b1/w e b2/w
+		float B10, B1dx, B1dy, B20, B2dx, B2dy;
+		ts.plane<Policy::perspective>(0.0f, 1.0f, 0.0f, B10, B1dx, B1dy);
+		ts.plane<Policy::perspective>(0.0f, 0.0f, 1.0f, B20, B2dx, B2dy);
+
+		Scissor S{0, 0, image.width(), image.height()};
+		rasterizeSpans(ts, S, [&](int y, int x0, int x1){
+			float qy = y - ts.T[0][1];
+			float B1row = B10 + qy*B1dy;
+			float B2row = B20 + qy*B2dy;
+			float Wrow = ts.W0 + qy*ts.Wdy;
+			float Zrow = ts.Z0 + qy*ts.Zdy;
+
+			float B1 = 0, B2 = 0, W = 0, Z = 0;
+			for(int x = x0; x < x1; x++){
+				if(x == x0 || (x & 7) == 0){
+					float qx = x - ts.T[0][0];
+					B1 = B1row + qx*B1dx;
+					B2 = B2row + qx*B2dx;
+					W = Wrow + qx*ts.Wdx;
+					Z = Zrow + qx*ts.Zdx;
+				}
+				if(depthTest(x, y, Z)){
+					if constexpr(Policy::perspective)
+						vis(x, y) = {id, B1/W, B2/W};
+					else
+						vis(x, y) = {id, B1, B2};
+				}
+				B1 += B1dx;
+				B2 += B2dx;
+				W += ts.Wdx;
+				Z += ts.Zdx;
+			}
+		});
+	}
+
+	// Trechos do triângulo dentro de S; com teste de profundidade, os blocos
+	// 8x8 inteiramente atrás da geometria já desenhada são descartados
+	template<class Span>
+	void rasterizeSpans(const TriangleSetup& ts, Scissor S, Span span){
+		if constexpr(Policy::depth)
+			rasterizeTriangleSpans(ts.T, S, span, [&](int bx, int by){
+				return testBlock(bx, by, ts.block_zmin(bx, by), image);
+			});
+		else
+			rasterizeTriangleSpans(ts.T, S, span);
+	}
+
+	template<class Quad>
+	void rasterizeQuads(const TriangleSetup& ts, Scissor S, Quad quad){
+		if constexpr(Policy::depth)
+			rasterizeTriangleQuads(ts.T, S, quad, [&](int bx, int by){
+				return testBlock(bx, by, ts.block_zmin(bx, by), image);
+			});
+		else
+			rasterizeTriangleQuads(ts.T, S, quad, [](int, int){ return true; });
+	}
+
+	// Pixel (x, y) dentro da imagem, com profundidade z/w
+	bool depthTest(int x, int y, float z){
+		if constexpr(Policy::depth)
+			return testDepth(Pixel{x, y}, z, image);
+		else
+			return true;
+	}
+
+	// Escreve a cor do fragmento conforme o modo de mistura
+	void shade(int x, int y, const Varying& v){
+		if constexpr(Policy::blend == BLEND_REPLACE){
+			shader.fragmentShader(v, image(x, y));
+		}else{
+			std::decay_t<decltype(image(x, y))> src{};
+			shader.fragmentShader(v, src);
+			blend(x, y, src);
+		}
+	}
+
+	template<class Col>
+	void blend(int x, int y, const Col& src){
+		blend(image(x, y), src);
+	}
+
+	template<class Col>
+	void blend(Col& dst, const Col& src){
+		if constexpr(Policy::blend == BLEND_REPLACE){
+			dst = src;
+		}else{
+			for(unsigned int k = 0; k < dst.size(); k++)
+				dst[k] = std::min(255, dst[k] + src[k]);
 		}
 	}
 
@@ -64,8 +656,33 @@ struct RenderPipeline{
 	}
 
 	void paint(Pixel p, Varying v){
-		if(testPixel(p, v, image))
-			shader.fragmentShader(v, image(p.x,p.y));
+		if constexpr(is_multisample<ImageType>::value){
+			// linhas cobrem todas as amostras do pixel
+			if(p.x < 0 || p.y < 0 || p.x >= image.width() || p.y >= image.height())
+				return;
+			int n = image.samples();
+			unsigned int mask = (1u << n) - 1;
+			if constexpr(Policy::depth){
+				vec4 pos = getPosition(v);
+				float z[32];
+				std::fill_n(z, n, pos[2]/pos[3]);
+				mask = image.testSamples(p.x, p.y, z, mask);
+			}
+			if(mask == 0)
+				return;
+			RGB color;
+			shader.fragmentShader(v, color);
+			for(int s = 0; s < n; s++)
+				if(mask >> s & 1)
+					blend(image.sample(p.x, p.y, s), color);
+		}else{
+			if constexpr(Policy::depth){
+				if(!testPixel(p, v, image))
+					return;
+			}else if(p.x < 0 || p.y < 0 || p.x >= image.width() || p.y >= image.height())
+				return;
+			shade(p.x, p.y, v);
+		}
 	}
 };
 
@@ -74,8 +691,89 @@ bool testPixel(Pixel p, Varying, ImageRGB& img){
 	return p.x >= 0 && p.y >= 0 && p.x < img.width() && p.y < img.height();
 }
 
-template<class VertexAttrib, class Prims, class Shader, class ImageType>
+// Sem buffer de profundidade: só o teste de limites
+inline bool testDepth(Pixel p, float, ImageRGB& img){
+	return p.x >= 0 && p.y >= 0 && p.x < img.width() && p.y < img.height();
+}
+
+inline bool testBlock(int, int, float, ImageRGB&){
+	return true;
+}
+
+// Profundidade: Image<float> guarda z/w e o teste grava o menor valor
+inline bool testDepth(Pixel p, float z, Image<float>& depth){
+	if(p.x < 0 || p.y < 0 || p.x >= depth.width() || p.y >= depth.height())
+		return false;
+
+	float& d = depth(p.x, p.y);
+	if(z < d){
+		d = z;
+		return true;
+	}
+	return false;
+}
+
+inline bool testBlock(int, int, float, Image<float>&){
+	return true;
+}
+
+template<class Varying>
+bool testPixel(Pixel p, Varying v, Image<float>& depth){
+	vec4 pos = getPosition(v);
+	return testDepth(p, pos[2]/pos[3], depth);
+}
+
+// Shader da passada só de profundidade: só a posição é transformada
+struct DepthShader{
+	using Varying = vec4;
+
+	mat4 M;
+
+	template<class Vertex>
+	void vertexShader(Vertex in, Varying& out){
+		out = M*getPosition(in);
+	}
+
+	void fragmentShader(Varying, float&){}
+};
+
+template<class Policy = DefaultPolicy, class VertexAttrib, class Prims, class Shader, class ImageType>
 void render(const VertexAttrib& V, const Prims& p, Shader& shader, ImageType& image){
-	RenderPipeline<Shader, ImageType> pipeline{shader, image};
+	RenderPipeline<Shader, ImageType, Policy> pipeline{shader, image};
 	pipeline.run(V, p); 
 }
+
+template<class Policy = DefaultPolicy, class VertexAttrib, class Prims, class Shader, class ImageType>
+void render_deferred(const VertexAttrib& V, const Prims& p, Shader& shader, ImageType& image){
+	RenderPipeline<Shader, ImageType, Policy> pipeline{shader, image};
+	pipeline.run_deferred(V, p);
+}
+
+template<class Policy = DefaultPolicy, class VertexAttrib, class Prims, class Shader, class ImageType>
+void render_binned(const VertexAttrib& V, const Prims& p, Shader& shader, ImageType& image){
+	RenderPipeline<Shader, ImageType, Policy> pipeline{shader, image};
+	pipeline.run_binned(V, p); 
+}
+
+// Desenha cada faixa de ranges depois de chamar setup(k), transformando
+// os vértices de V uma só vez
+template<class Policy = DefaultPolicy, class VertexAttrib, class Ranges, class Shader, class ImageType, class Setup>
+void render_ranges(const VertexAttrib& V, const Ranges& ranges, Shader& shader, ImageType& image, Setup setup){
+	RenderPipeline<Shader, ImageType, Policy> pipeline{shader, image};
+	pipeline.run_ranges(V, ranges, setup);
+}
+
+template<class Policy = DefaultPolicy, class VertexAttrib, class Ranges, class Shader, class ImageType, class Setup>
+void render_ranges_binned(const VertexAttrib& V, const Ranges& ranges, Shader& shader, ImageType& image, Setup setup){
+	RenderPipeline<Shader, ImageType, Policy> pipeline{shader, image};
+	pipeline.run_ranges_binned(V, ranges, setup);
+}
+
+// Desenha só a profundidade (z/w depois de M) em depth, que deve estar
+// preenchida com 1 antes da primeira chamada
+template<class Policy = DefaultPolicy, class VertexAttrib, class Prims>
+void render_depth(const VertexAttrib& V, const Prims& p, const mat4& M, Image<float>& depth){
+	DepthShader shader{M};
+	RenderPipeline<DepthShader, Image<float>, Policy> pipeline{shader, depth};
+	pipeline.run(V, p);
+}
@@ -13,21 +13,86 @@ class Sampler2D{
 	WrapMode wrapX, wrapY;
 	RGB default_color = magenta;
 
+	// Níveis 1, 2, ... de mipmap (o nível 0 é img), criados por generateMipmaps
+	std::vector<ImageRGB> mipmaps = {};
+
 	RGB sample(vec2 texCoords) const{
 		if(img.width() == 0 || img.height() == 0)
 			return default_color;
 
-		float sx = texCoords[0]*img.width() - 0.5;
-		float sy = texCoords[1]*img.height() - 0.5;
+		return sample(img, texCoords);
+	}
+
+	// Amostra com as derivadas das coordenadas de textura na tela, que
+	// escolhem o nível de mipmap (filtragem trilinear entre dois níveis).
+	// Sem mipmaps, é igual a sample(texCoords).
+	RGB sample(vec2 texCoords, vec2 ddx, vec2 ddy) const{
+		if(!hasMipmaps())
+			return sample(texCoords);
 
-		if(filter == BILINEAR)
-			return sampleBI(sx, sy);
+		float dx = hypot(ddx[0]*img.width(), ddx[1]*img.height());
+		float dy = hypot(ddy[0]*img.width(), ddy[1]*img.height());
+		float lod = log2(std::max(dx, dy));
+		if(!(lod > 0))
+			return sample(img, texCoords);
+
+		lod = std::min(lod, (float)mipmaps.size());
+		int l = lod;
+		if(l == (int)mipmaps.size())
+			return sample(mipmaps.back(), texCoords);
+
+		RGB c0 = sample(l == 0? img: mipmaps[l-1], texCoords);
+		RGB c1 = sample(mipmaps[l], texCoords);
+		return lerp(lod - l, c0, c1);
+	}
+
+	// Gera os mipmaps de img: cada nível tem metade do tamanho do anterior
+	// (média de 2x2 pixels), até 1x1. Deve ser chamada de novo quando img mudar.
+	void generateMipmaps(){
+		mipmaps.clear();
+		int n = 0;
+		for(int w = img.width(), h = img.height(); w > 1 || h > 1; w = std::max(1, w/2), h = std::max(1, h/2))
+			n++;
+		mipmaps.reserve(n);
 
-		return sampleNN(sx, sy);
+		const ImageRGB* prev = &img;
+		for(int l = 0; l < n; l++){
+			int w = std::max(1, prev->width()/2);
+			int h = std::max(1, prev->height()/2);
+			ImageRGB level{w, h};
+			for(int y = 0; y < h; y++)
+				for(int x = 0; x < w; x++){
+					int x0 = std::min(2*x, prev->width()-1), x1 = std::min(2*x+1, prev->width()-1);
+					int y0 = std::min(2*y, prev->height()-1), y1 = std::min(2*y+1, prev->height()-1);
+					for(int c = 0; c < 3; c++){
+						int sum = (*prev)(x0, y0)[c] + (*prev)(x1, y0)[c] + (*prev)(x0, y1)[c] + (*prev)(x1, y1)[c];
+						level(x, y)[c] = (sum + 2)/4;
+					}
+				}
+			mipmaps.push_back(std::move(level));
+			prev = &mipmaps.back();
+		}
 	}
 
 	private:
-	RGB sampleNN(float sx, float sy) const{
+	// mipmaps gerados para o img atual
+	bool hasMipmaps() const{
+		return !mipmaps.empty() && img.width() > 0 && img.height() > 0 &&
+			mipmaps[0].width() == std::max(1, img.width()/2) &&
+			mipmaps[0].height() == std::max(1, img.height()/2);
+	}
+
+	RGB sample(const ImageRGB& level, vec2 texCoords) const{
+		float sx = texCoords[0]*level.width() - 0.5;
+		float sy = texCoords[1]*level.height() - 0.5;
+
+		if(filter == BILINEAR)
+			return sampleBI(level, sx, sy);
+
+		return sampleNN(level, sx, sy);
+	}
+
+	RGB sampleNN(const ImageRGB& img, float sx, float sy) const{
 		int x = round(sx);
 		int y = round(sy);
 		
@@ -36,7 +101,7 @@ class Sampler2D{
 		return img(x, y);
 	}
 
-	RGB sampleBI(float sx, float sy) const{
+	RGB sampleBI(const ImageRGB& img, float sx, float sy) const{
 		int x = floor(sx);
 		int y = floor(sy);
 		float u = sx - x;
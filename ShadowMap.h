@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Render3D.h"
+#include "transforms.h"
+
+// Mapa de sombra para shaders da CPU: a profundidade da cena vista pela
+// luz, desenhada com render_depth, e a consulta com filtro PCF.
+struct ShadowMap{
+	Image<float> depth;
+	mat4 LightSpace = loadIdentity();  // Projection*View da luz
+	float bias = 0.005;                // em z/w, contra auto-sombreamento
+	int pcf = 1;                       // raio do filtro: (2*pcf + 1)^2 amostras
+
+	ShadowMap(int w, int h): depth{w, h}{
+		clear();
+	}
+
+	void clear(){
+		depth.fill(1.0f);
+	}
+
+	// Acrescenta a geometria V, com a matriz de modelo Model, ao mapa
+	template<class VertexAttrib, class Prims>
+	void render(const VertexAttrib& V, const Prims& p, const mat4& Model){
+		render_depth(V, p, LightSpace*Model, depth);
+	}
+
+	// Fração iluminada (de 0 a 1) do ponto P, dado em coordenadas de
+	// recorte da luz (LightSpace*Model*posição). Pontos fora do mapa são
+	// considerados iluminados.
+	float visibility(vec4 P) const{
+		if(P[3] <= 0)
+			return 1;
+
+		float x = ((P[0]/P[3] + 1)*depth.width() - 1)/2;
+		float y = ((P[1]/P[3] + 1)*depth.height() - 1)/2;
+		float z = P[2]/P[3] - bias;
+		if(z > 1)
+			return 1;
+
+		int px = round(x);
+		int py = round(y);
+		if(px < -pcf || py < -pcf || px >= depth.width() + pcf || py >= depth.height() + pcf)
+			return 1;
+
+		int lit = 0, n = 0;
+		for(int dy = -pcf; dy <= pcf; dy++)
+			for(int dx = -pcf; dx <= pcf; dx++){
+				int sx = std::clamp(px + dx, 0, depth.width() - 1);
+				int sy = std::clamp(py + dy, 0, depth.height() - 1);
+				lit += z <= depth(sx, sy);
+				n++;
+			}
+		return lit/(float)n;
+	}
+};
@@ -17,6 +17,11 @@ struct TextureShader{
 
 	mat4 M;
 	Sampler2D texture;
+	const Sampler2D* sampler = nullptr;   // textura compartilhada; se nulo, usa texture
+
+	const Sampler2D& tex() const{
+		return sampler? *sampler: texture;
+	}
 
 	template<class Vertex>
 	void vertexShader(Vertex in, Varying& out){
@@ -25,7 +30,17 @@ struct TextureShader{
 	}
 
 	void fragmentShader(Varying V, RGB& FragColor){
-		FragColor = texture.sample(V.texCoords);
+		FragColor = tex().sample(V.texCoords);
+	}
+
+	// Quad 2x2: as derivadas das coordenadas de textura escolhem o mipmap
+	void fragmentShader4(const Varying (&V)[4], unsigned int mask, RGB (&FragColor)[4]){
+		vec2 ddx = V[1].texCoords - V[0].texCoords;
+		vec2 ddy = V[2].texCoords - V[0].texCoords;
+		const Sampler2D& t = tex();
+		for(int i = 0; i < 4; i++)
+			if(mask >> i & 1)
+				FragColor[i] = t.sample(V[i].texCoords, ddx, ddy);
 	}
 };
 
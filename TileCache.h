@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <typeinfo>
+#include <vector>
+#include "Render3D.h"
+#include "ZBuffer.h"
+
+// Redesenho incremental por tiles, para animações em que a maior parte da
+// cena fica parada. Os desenhos de um quadro são só registrados (vértices
+// já transformados, triângulos distribuídos nos tiles e uma cópia do
+// shader) e executados em finish(). A assinatura de cada tile combina os
+// Varyings dos triângulos que o tocam, na ordem de submissão, e o estado
+// de cada desenho: tiles com a mesma assinatura do quadro anterior mantêm
+// a cor e a profundidade, e só os demais são limpos e redesenhados.
+// Como a assinatura usa os vértices transformados, mover a câmera suja
+// todos os tiles. O estado do shader de fragmento (cores, texturas) não
+// aparece nos Varyings: quem o muda entre quadros deve passar um hash em
+// state. Tiles tocados por Varyings não planos são sempre redesenhados.
+// Só primitivas de triângulos são aceitas (linhas não passam pelo
+// scissor dos tiles); draw() rejeita as demais na compilação.
+class TileCache{
+	struct DrawCall{
+		virtual ~DrawCall(){}
+		// Combina a assinatura dos triângulos do desenho em cada tile
+		virtual void sign(std::vector<uint64_t>& signature, uint64_t frame) const = 0;
+		// Desenha os triângulos do tile b, limitados por S
+		virtual void draw(int b, Scissor S) = 0;
+	};
+
+	template<class Shader, class Policy>
+	struct Call : DrawCall{
+		using Pipeline = RenderPipeline<Shader, ImageZBuffer, Policy>;
+		using Varying = typename Shader::Varying;
+
+		Shader shader;
+		Pipeline pipeline;
+		typename Pipeline::VertexCache cache;
+		std::vector<Triangle<unsigned int>> tris;
+		std::vector<std::vector<unsigned int>> bins;
+		uint64_t state;
+
+		Call(const Shader& shader, ImageZBuffer& zbuffer, size_t n, uint64_t state):
+			shader{shader}, pipeline{this->shader, zbuffer}, cache{n},
+			state{mix(state, typeid(Call).hash_code())}
+		{}
+
+		void sign(std::vector<uint64_t>& signature, uint64_t frame) const override{
+			// assinatura de cada vértice, calculada uma só vez
+			size_t n = cache.PV.size() + cache.extra.size();
+			std::vector<uint64_t> vh(n);
+			for(size_t i = 0; i < n; i++){
+				if constexpr(is_flat_varying_v<Varying>){
+					uint32_t w[sizeof(Varying)/sizeof(uint32_t)];
+					memcpy(w, &cache[i], sizeof(Varying));
+					uint64_t h = FNV_OFFSET;
+					for(uint32_t x: w)
+						h = mix(h, x);
+					vh[i] = h;
+				}else{
+					vh[i] = frame;
+				}
+			}
+
+			for(size_t b = 0; b < bins.size(); b++){
+				if(bins[b].empty())
+					continue;
+				uint64_t h = mix(signature[b], state);
+				for(unsigned int i: bins[b])
+					h = mix(mix(mix(h, vh[tris[i][0]]), vh[tris[i][1]]), vh[tris[i][2]]);
+				signature[b] = h;
+			}
+		}
+
+		void draw(int b, Scissor S) override{
+			for(unsigned int i: bins[b])
+				pipeline.draw(cache[tris[i][0]], cache[tris[i][1]], cache[tris[i][2]], S);
+		}
+	};
+
+	static constexpr uint64_t FNV_OFFSET = 0xcbf29ce484222325ull;
+
+	static uint64_t mix(uint64_t h, uint64_t x){
+		return (h ^ x)*0x100000001b3ull;
+	}
+
+	ImageRGB& img;
+	ImageZBuffer zbuffer;
+	RGB background;
+	int tile_size, ntx, nty;
+	std::vector<std::unique_ptr<DrawCall>> calls;
+	std::vector<uint64_t> signature;
+	uint64_t frame = 0;
+	bool valid = false;
+
+	public:
+	// O tamanho do tile é arredondado para múltiplo de 8, como em run_binned
+	TileCache(ImageRGB& img, RGB background, int tile_size = 64):
+		img{img}, zbuffer{img}, background{background},
+		tile_size{(std::max(tile_size, 1) + 7) & ~7},
+		ntx{(img.width() + this->tile_size - 1)/this->tile_size},
+		nty{(img.height() + this->tile_size - 1)/this->tile_size},
+		signature(ntx*nty)
+	{}
+
+	int tiles() const { return ntx*nty; }
+
+	// Faz o próximo finish() redesenhar todos os tiles (por exemplo, depois
+	// de a imagem ser alterada por fora)
+	void invalidate(){
+		valid = false;
+	}
+
+	// Registra o desenho das primitivas p com o shader (que é copiado)
+	template<class Policy = DefaultPolicy, class VertexAttrib, class Prims, class Shader>
+	void draw(const VertexAttrib& V, const Prims& p, const Shader& shader, uint64_t state = 0){
+		auto call = std::make_unique<Call<Shader, Policy>>(shader, zbuffer, std::size(V), state);
+		std::vector<unsigned int> seq = identity_indices(std::size(V));
+
+		for(unsigned int i = 0; i < p.size(); i++){
+			auto prim = p.assemble(i, seq.data());
+			static_assert(std::is_same_v<decltype(prim), Triangle<unsigned int>>, "TileCache só desenha triângulos");
+			call->pipeline.fetch(V, call->cache, prim);
+			call->pipeline.cull_clip(call->cache, prim, [&](const Triangle<unsigned int>& q){
+				call->tris.push_back(q);
+			});
+		}
+		call->bins = call->pipeline.bin_triangles(call->cache, call->tris, tile_size);
+		calls.push_back(std::move(call));
+	}
+
+	// Redesenha os tiles que mudaram desde o último quadro e descarta os
+	// desenhos registrados. Devolve o número de tiles redesenhados.
+	int finish(){
+		frame++;
+		std::vector<uint64_t> s(ntx*nty, FNV_OFFSET);
+		for(const auto& call: calls)
+			call->sign(s, frame);
+
+		std::vector<int> dirty;
+		for(int b = 0; b < ntx*nty; b++)
+			if(!valid || s[b] != signature[b])
+				dirty.push_back(b);
+
+		#pragma omp parallel for schedule(dynamic, 1)
+		for(size_t k = 0; k < dirty.size(); k++){
+			int b = dirty[k];
+			int x0 = (b%ntx)*tile_size;
+			int y0 = (b/ntx)*tile_size;
+			Scissor S{x0, y0, std::min(x0 + tile_size, img.width()), std::min(y0 + tile_size, img.height())};
+
+			for(int y = S.y0; y < S.y1; y++)
+				std::fill(&img(S.x0, y), &img(S.x0, y) + (S.x1 - S.x0), background);
+			zbuffer.clear(S.x0, S.y0, S.x1, S.y1);
+
+			for(const auto& call: calls)
+				call->draw(b, S);
+		}
+
+		signature = s;
+		valid = true;
+		calls.clear();
+		return dirty.size();
+	}
+};
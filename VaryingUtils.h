@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstring>
+#include <type_traits>
+
+// Um Varying é plano quando pode ser tratado como um vetor de floats:
+// standard-layout, trivialmente copiável, alinhado como float e com
+// tamanho múltiplo de float (por exemplo, structs só com vecN e floats).
+// Nesse caso o pipeline interpola, recorta e divide por w com laços
+// sobre os floats, sem os operadores * e + do shader. Um Varying com
+// membros que não devem ser interpolados (inteiros, ponteiros) deve
+// especializar is_flat_varying como std::false_type.
+template<class Varying>
+struct is_flat_varying : std::bool_constant<
+	std::is_standard_layout_v<Varying> &&
+	std::is_trivially_copyable_v<Varying> &&
+	alignof(Varying) == alignof(float) &&
+	sizeof(Varying) % sizeof(float) == 0
+>{};
+
+template<class Varying>
+constexpr bool is_flat_varying_v = is_flat_varying<Varying>::value;
+
+// Número de floats de um Varying plano
+template<class Varying>
+constexpr int flat_size = sizeof(Varying)/sizeof(float);
+
+// Aplica f(R, A, B, C) sobre os floats dos Varyings, com R de saída
+template<class Varying, class F>
+Varying flat_apply(const Varying& a, const Varying& b, const Varying& c, F f){
+	const int N = flat_size<Varying>;
+	float A[N], B[N], C[N], R[N];
+	memcpy(A, &a, sizeof(Varying));
+	memcpy(B, &b, sizeof(Varying));
+	memcpy(C, &c, sizeof(Varying));
+	for(int i = 0; i < N; i++)
+		R[i] = f(A[i], B[i], C[i]);
+
+	Varying r;
+	memcpy(&r, R, sizeof(Varying));
+	return r;
+}
+
+// s*u
+template<class Varying>
+Varying varying_scale(float s, const Varying& u){
+	if constexpr(is_flat_varying_v<Varying>)
+		return flat_apply(u, u, u, [s](float a, float, float){ return s*a; });
+	else
+		return s*u;
+}
+
+// u + s*v
+template<class Varying>
+Varying varying_madd(const Varying& u, float s, const Varying& v){
+	if constexpr(is_flat_varying_v<Varying>)
+		return flat_apply(u, v, v, [s](float a, float b, float){ return a + s*b; });
+	else
+		return u + s*v;
+}
+
+// (1-t)*u + t*v
+template<class Varying>
+Varying varying_lerp(float t, const Varying& u, const Varying& v){
+	if constexpr(is_flat_varying_v<Varying>)
+		return flat_apply(u, v, v, [t](float a, float b, float){ return (1-t)*a + t*b; });
+	else
+		return (1-t)*u + t*v;
+}
+
+// a*u + b*v + c*w
+template<class Varying>
+Varying varying_combine(float a, const Varying& u, float b, const Varying& v, float c, const Varying& w){
+	if constexpr(is_flat_varying_v<Varying>)
+		return flat_apply(u, v, w, [a, b, c](float x, float y, float z){ return a*x + b*y + c*z; });
+	else
+		return a*u + b*v + c*w;
+}
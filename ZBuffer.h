@@ -2,31 +2,210 @@
 
 #include "Render3D.h"
 
+// Buffer de profundidade dividido em tiles de 8x8 (os mesmos blocos do
+// rasterizador). Cada tile guarda a maior profundidade que contém, usada
+// para descartar blocos inteiros atrás da geometria já desenhada, e é
+// limpo só quando for escrito pela primeira vez.
 class ImageZBuffer{
+	static const int TILE = 8;
+
+	enum TileFlags : unsigned char{
+		CLEARED = 1,  // tile ainda não foi preenchido com clear_depth
+		DIRTY   = 2,  // tile_max precisa ser recalculado
+	};
+
 	ImageRGB& img;
 	Image<float> zbuf;
+	int ntx, nty;
+	std::vector<float> tile_max;
+	std::vector<unsigned char> tile_flags;
+	float clear_depth = 1.0f;
 
 	public:
-	ImageZBuffer(ImageRGB& img): img{img}, zbuf{img.width(), img.height()}{
-		zbuf.fill(1.0f);
+	ImageZBuffer(ImageRGB& img):
+		img{img}, zbuf{img.width(), img.height()},
+		ntx{(img.width() + TILE - 1)/TILE}, nty{(img.height() + TILE - 1)/TILE},
+		tile_max(ntx*nty), tile_flags(ntx*nty)
+	{
+		clear();
 	}
 
 	int width() const { return img.width(); }
 	int height() const { return img.height(); }
 	RGB& operator()(int x, int y){ return img(x,y); }
 
-	template<class Varying>
-	friend bool testPixel(Pixel p, Varying v, ImageZBuffer& zbuffer){
-		if(!testPixel(p, v, zbuffer.img))
+	// Limpa a profundidade (sem tocar nos pixels de cor)
+	void clear(float z = 1.0f){
+		clear_depth = z;
+		std::fill(tile_max.begin(), tile_max.end(), z);
+		std::fill(tile_flags.begin(), tile_flags.end(), CLEARED);
+	}
+
+	// Limpa a profundidade do retângulo [x0,x1)x[y0,y1) com o valor do último clear()
+	void clear(int x0, int y0, int x1, int y1){
+		x0 = std::max(x0, 0); x1 = std::min(x1, width());
+		y0 = std::max(y0, 0); y1 = std::min(y1, height());
+		for(int ty = y0/TILE; ty*TILE < y1; ty++)
+			for(int tx = x0/TILE; tx*TILE < x1; tx++){
+				int t = ty*ntx + tx;
+				int bx0 = tx*TILE, bx1 = std::min(bx0 + TILE, width());
+				int by0 = ty*TILE, by1 = std::min(by0 + TILE, height());
+				if(bx0 >= x0 && bx1 <= x1 && by0 >= y0 && by1 <= y1){
+					tile_flags[t] = CLEARED;
+					tile_max[t] = clear_depth;
+				}else{
+					for(int y = std::max(by0, y0); y < std::min(by1, y1); y++)
+						for(int x = std::max(bx0, x0); x < std::min(bx1, x1); x++)
+							depth_ref(x, y) = clear_depth;
+					tile_flags[t] |= DIRTY;
+				}
+			}
+	}
+
+	// Profundidade de um pixel, para leitura
+	float depth(int x, int y) const{
+		if(tile_flags[tile(x, y)] & CLEARED)
+			return clear_depth;
+		return zbuf(x, y);
+	}
+
+	// Maior profundidade do tile que contém o pixel (bx, by)
+	float max_depth(int bx, int by){
+		int t = tile(bx, by);
+		if(tile_flags[t] & DIRTY){
+			int x0 = (t%ntx)*TILE, x1 = std::min(x0 + TILE, width());
+			int y0 = (t/ntx)*TILE, y1 = std::min(y0 + TILE, height());
+			float m = -INFINITY;
+			for(int y = y0; y < y1; y++)
+				for(int x = x0; x < x1; x++)
+					m = std::max(m, zbuf(x, y));
+			tile_max[t] = m;
+			tile_flags[t] &= ~DIRTY;
+		}
+		return tile_max[t];
+	}
+
+	// Teste de profundidade antecipado: z é a profundidade (z/w) do fragmento
+	friend bool testDepth(Pixel p, float z, ImageZBuffer& zbuffer){
+		if(p.x < 0 || p.y < 0 || p.x >= zbuffer.width() || p.y >= zbuffer.height())
 			return false;
-	
-		vec4 pos = getPosition(v);
-		float z = pos[2]/pos[3];
-		float& zb = zbuffer.zbuf(p.x, p.y);
+
+		float& zb = zbuffer.depth_ref(p.x, p.y);
 		if(z < zb){
 			zb = z;
+			zbuffer.tile_flags[zbuffer.tile(p.x, p.y)] |= DIRTY;
 			return true;
 		}
 		return false;
 	}
-};
\ No newline at end of file
+
+	// Algum pixel do bloco 8x8 em (bx, by) pode passar com profundidade >= zmin?
+	friend bool testBlock(int bx, int by, float zmin, ImageZBuffer& zbuffer){
+		return zmin < zbuffer.max_depth(bx, by);
+	}
+
+	template<class Varying>
+	friend bool testPixel(Pixel p, Varying v, ImageZBuffer& zbuffer){
+		vec4 pos = getPosition(v);
+		return testDepth(p, pos[2]/pos[3], zbuffer);
+	}
+
+	private:
+	int tile(int x, int y) const{
+		return (y/TILE)*ntx + x/TILE;
+	}
+
+	float& depth_ref(int x, int y){
+		int t = tile(x, y);
+		if(tile_flags[t] & CLEARED){
+			int x0 = (t%ntx)*TILE, x1 = std::min(x0 + TILE, width());
+			int y0 = (t/ntx)*TILE, y1 = std::min(y0 + TILE, height());
+			for(int yy = y0; yy < y1; yy++)
+				std::fill(&zbuf(x0, yy), &zbuf(x0, yy) + (x1 - x0), clear_depth);
+			tile_flags[t] &= ~CLEARED;
+		}
+		return zbuf(x, y);
+	}
+};
+
+// Buffer de profundidade com várias amostras por pixel (MSAA: 1, 2, 4 ou 8),
+// com cor e profundidade por amostra. Cada triângulo é sombreado uma vez
+// por pixel, e a cor vai para as amostras cobertas que passam no teste de
+// profundidade; resolve() grava na imagem a média das amostras.
+class ImageZBufferMSAA{
+	ImageRGB& img;
+	int n;
+	std::vector<RGB> colors;
+	std::vector<float> depths;
+
+	public:
+	using Offset = int[2];
+
+	// As amostras começam com a cor atual da imagem
+	ImageZBufferMSAA(ImageRGB& img, int samples = 4):
+		img{img}, n{samples >= 8? 8: samples >= 4? 4: samples >= 2? 2: 1},
+		colors(img.width()*img.height()*n), depths(img.width()*img.height()*n, 1.0f)
+	{
+		for(int y = 0; y < height(); y++)
+			for(int x = 0; x < width(); x++)
+				std::fill_n(&sample(x, y, 0), n, img(x, y));
+	}
+
+	int width() const { return img.width(); }
+	int height() const { return img.height(); }
+	int samples() const { return n; }
+
+	// Posição das amostras em relação ao centro do pixel, em 1/16 de pixel
+	// (os padrões usuais do Direct3D)
+	const Offset* sample_offsets() const{
+		static const Offset p1[] = {{0, 0}};
+		static const Offset p2[] = {{4, 4}, {-4, -4}};
+		static const Offset p4[] = {{-2, -6}, {6, -2}, {-6, 2}, {2, 6}};
+		static const Offset p8[] = {{1, -3}, {-1, 3}, {5, 1}, {-3, -5}, {-5, 5}, {-7, -1}, {3, 7}, {7, -7}};
+		return n == 8? p8: n == 4? p4: n == 2? p2: p1;
+	}
+
+	RGB& sample(int x, int y, int s){
+		return colors[(y*width() + x)*n + s];
+	}
+
+	// Limpa a profundidade (sem tocar nas cores)
+	void clear(float z = 1.0f){
+		std::fill(depths.begin(), depths.end(), z);
+	}
+
+	void fill(RGB color){
+		std::fill(colors.begin(), colors.end(), color);
+	}
+
+	// Teste de profundidade das amostras de mask do pixel (x, y), com
+	// profundidade z[s]; retorna as que passaram, já gravadas
+	unsigned int testSamples(int x, int y, const float* z, unsigned int mask){
+		float* zb = &depths[(y*width() + x)*n];
+		for(int s = 0; s < n; s++)
+			if(mask >> s & 1){
+				if(z[s] < zb[s])
+					zb[s] = z[s];
+				else
+					mask &= ~(1u << s);
+			}
+		return mask;
+	}
+
+	// Média das amostras de cada pixel
+	void resolve(){
+		for(int y = 0; y < height(); y++)
+			for(int x = 0; x < width(); x++){
+				const RGB* c = &sample(x, y, 0);
+				for(int k = 0; k < 3; k++){
+					int sum = 0;
+					for(int s = 0; s < n; s++)
+						sum += c[s][k];
+					img(x, y)[k] = (sum + n/2)/n;
+				}
+			}
+	}
+};
+
+template<>
+struct is_multisample<ImageZBufferMSAA> : std::true_type{};
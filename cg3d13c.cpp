@@ -4,10 +4,12 @@
 #include "ObjMesh.h"
 #include "transforms.h"
 #include "ImageSet.h"
+#include "Animation.h"
 
 class Mesh{
 	std::vector<ObjMesh::Vertex> tris;
 	std::vector<MaterialRange> materials;
+	std::vector<TrianglesRange> ranges;
 	ImageSet image_set;
 	public:
 	mat4 Model;
@@ -21,18 +23,20 @@ class Mesh{
 
 		materials = mesh.getMaterials(std_mat);
 
-		for(MaterialRange range: materials)
+		for(MaterialRange range: materials){
 			image_set.load_texture(mesh.path, range.mat.map_Kd);
+			ranges.push_back({range.first, range.count});
+		}
 
 		Model = _Model;
 	}
 	
 	void draw(ImageZBuffer& G, TextureShader& shader) const{
-		for(MaterialRange range: materials){
-			image_set.get_texture(range.mat.map_Kd, shader.texture.img);
-			TrianglesRange T{range.first, range.count};
-			render(tris, T, shader, G);
-		}
+		// vértices transformados uma vez, compartilhados pelos materiais
+		render_ranges(tris, ranges, shader, G, [&](unsigned int k){
+			const MaterialInfo& mat = materials[k].mat;
+			shader.sampler = image_set.get_sampler(mat.map_Kd);
+		});
 	}
 };
 
@@ -45,7 +49,6 @@ int main(){
 	};
 
 	int w = 800, h = 600;
-	ImageRGB G{w, h};
 	
 	TextureShader shader;
 	shader.texture.filter = BILINEAR;
@@ -56,20 +59,14 @@ int main(){
 	float a = w/(float)h;
 	mat4 Projection = perspective(45, a, 0.1, 100);
 
+	// vários quadros renderizados ao mesmo tempo, cada um com seu shader
 	int nframes = 40;
-	for(int k = 0; k < nframes; k++){
-		G.fill(white);
-		ImageZBuffer I{G};
-		
+	render_animation(nframes, w, h, white, "anim/output%03d.png", [&](int k, ImageZBuffer& I){
 		float theta = k*2*M_PI/(nframes-1);
 		mat4 Model = rotate_y(theta)*mesh.Model;
-		shader.M = Projection*View*Model;
 
-		mesh.draw(I, shader);
-		
-		char filename[30];
-		sprintf(filename, "anim/output%03d.png", k);
-		puts(filename);
-		G.savePNG(filename);
-	}
+		TextureShader frame_shader = shader;
+		frame_shader.M = Projection*View*Model;
+		mesh.draw(I, frame_shader);
+	});
 }
@@ -8,6 +8,7 @@
 class Mesh{
 	std::vector<ObjMesh::Vertex> tris;
 	std::vector<MaterialRange> materials;
+	std::vector<TrianglesRange> ranges;
 	ImageSet image_set;
 	public:
 	mat4 Model;
@@ -21,19 +22,21 @@ class Mesh{
 
 		materials = mesh.getMaterials(std_mat);
 
-		for(MaterialRange range: materials)
+		for(MaterialRange range: materials){
 			image_set.load_texture(mesh.path, range.mat.map_Kd);
+			ranges.push_back({range.first, range.count});
+		}
 
 		Model = _Model;
 	}
 
 	void draw(ImageZBuffer& G, TextureShader& shader) const{
-		for(MaterialRange range: materials){
-			shader.texture.default_color = toColor(range.mat.Kd);
-			image_set.get_texture(range.mat.map_Kd, shader.texture.img);
-			TrianglesRange T{range.first, range.count};
-			render(tris, T, shader, G);
-		}
+		// vértices transformados uma vez, compartilhados pelos materiais
+		render_ranges_binned(tris, ranges, shader, G, [&](unsigned int k){
+			const MaterialInfo& mat = materials[k].mat;
+			shader.texture.default_color = toColor(mat.Kd);
+			shader.sampler = image_set.get_sampler(mat.map_Kd);
+		});
 	}
 };
 
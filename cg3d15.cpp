@@ -0,0 +1,80 @@
+#include "Render3D.h"
+#include "ZBuffer.h"
+#include "ShadowMap.h"
+#include "Animation.h"
+#include "ObjMesh.h"
+#include "transforms.h"
+
+// Iluminação difusa com a sombra de uma luz direcional
+struct ShadowShader{
+	struct Varying{
+		vec4 position;
+		vec4 lightPos;   // posição em coordenadas de recorte da luz
+		vec3 normal;
+	};
+
+	mat4 M, Model;
+	vec3 light_dir;
+	vec3 color;
+	const ShadowMap* shadow;
+
+	template<class Vertex>
+	void vertexShader(Vertex in, Varying& out){
+		vec4 P = getPosition(in);
+		out.position = M*P;
+		out.lightPos = shadow->LightSpace*Model*P;
+		out.normal = toVec3(Model*toVec4(in.normal, 0));
+	}
+
+	void fragmentShader(Varying V, RGB& FragColor){
+		float d = std::max(0.0f, dot(normalize(V.normal), light_dir));
+		float s = shadow->visibility(V.lightPos);
+		FragColor = toColor((0.25f + 0.75f*s*d)*color);
+	}
+};
+
+struct Object{
+	std::vector<ObjMesh::Vertex> tris;
+	mat4 Model;
+	vec3 color;
+};
+
+int main(){
+	std::vector<Object> objects = {
+		{ObjMesh{"modelos/floor.obj"}.getTriangles(), scale(8, 8, 8), {0.8, 0.8, 0.8}},
+		{ObjMesh{"modelos/box.obj"}.getTriangles(), translate(2, 1, -1), {0.9, 0.4, 0.2}},
+		{ObjMesh{"modelos/pose/pose.obj"}.getTriangles(), translate(-1, 0, 1)*scale(0.012, 0.012, 0.012), {0.3, 0.5, 0.9}},
+	};
+
+	int w = 800, h = 600;
+
+	// luz direcional: projeção ortogonal ao longo da direção da luz
+	vec3 light_dir = normalize(vec3{4, 10, 3});
+	mat4 LightSpace = orthogonal(-9, 9, -9, 9, 1, 40)*lookAt(20*light_dir, {0, 0, 0}, {0, 1, 0});
+
+	float a = w/(float)h;
+	mat4 Projection = perspective(45, a, 0.1, 100);
+	mat4 View = lookAt({7, 6, 10}, {0, 1, 0}, {0, 1, 0});
+
+	int nframes = 40;
+	render_animation(nframes, w, h, 0xA0C8F0_rgb, "anim/output%03d.png", [&](int k, ImageZBuffer& I){
+		float theta = k*2*M_PI/nframes;
+		mat4 Spin = rotate_y(theta);
+
+		// os quadros são desenhados em paralelo: mapa de sombra e shader próprios
+		ShadowMap shadow{1024, 1024};
+		shadow.LightSpace = LightSpace;
+		for(const Object& obj: objects)
+			shadow.render(obj.tris, Triangles{obj.tris.size()}, Spin*obj.Model);
+
+		ShadowShader shader;
+		shader.light_dir = light_dir;
+		shader.shadow = &shadow;
+		for(const Object& obj: objects){
+			shader.Model = Spin*obj.Model;
+			shader.M = Projection*View*shader.Model;
+			shader.color = obj.color;
+			render(obj.tris, Triangles{obj.tris.size()}, shader, I);
+		}
+	});
+}
@@ -8,6 +8,22 @@
 #define USE_BOUNDING_BOX
 #define USE_OCTREE
 #include "RTMesh.h"
+#include "LightTree.h"
+
+// Pré-passo de fótons: após o primeiro rebote difuso a luz indireta
+// vem do mapa de fótons em vez de continuar o caminho.
+// Indicado para cenas internas, onde poucas amostras bastam.
+//#define USE_PHOTON_MAP
+#include "PhotonMap.h"
+
+// Traçado de caminhos bidirecional: subcaminhos da câmera e das luzes
+// conectados em todos os vértices, com pesos de MIS (balance heuristic)
+//#define USE_BIDIRECTIONAL
+
+// Path guiding: o rebote difuso mistura a amostragem pelo cosseno com uma
+// distribuição de radiância aprendida em passadas progressivas (1, 2, 4... amostras)
+//#define USE_PATH_GUIDING
+#include "PathGuiding.h"
 
 static double random_value(double a, double b){
     static std::default_random_engine generator;
@@ -28,6 +44,14 @@ vec3 cos_random_dir(vec3 n){
     return normalize(sqrt(r2)*(cos(r1)*u + sin(r1)*v) + sqrt(1 - r2)*n);
 }
 
+// Direção aleatória uniforme na esfera
+vec3 uniform_random_dir(){
+    double z = random_value(-1, 1);
+    double phi = random_value(0, 2*M_PI);
+    double r = sqrt(1 - z*z);
+    return vec3{(float)(r*cos(phi)), (float)(r*sin(phi)), (float)z};
+}
+
 vec3 sky_color(){
     return vec3{1, 1, 1}; // cor do céu
 }
@@ -56,28 +80,55 @@ struct Scene{
     ImageRGB image;
     Camera camera;
     std::vector<RTMesh> meshes;
+    LightTree lights = {};
+    PhotonMap photon_map = {};
+    float photon_radius = 0;
+    mutable GuidingField guide = {};   // aprende durante a renderização
 
     void render(int nsamples){
-        #pragma omp parallel for schedule(dynamic, 1)  // OpenMP
-        for(int y = 0; y < image.height(); y++){
-            show_progress(y, image.height()-1);
-            for(int x = 0; x < image.width(); x++)
-                image(x, y) = color_at(x,y, nsamples);
+        // com path guiding, passadas com o dobro de amostras da anterior;
+        // cada passada usa o que foi aprendido nas anteriores
+        int w = image.width(), h = image.height();
+        std::vector<vec3> sum(w*h, vec3{0, 0, 0});
+        int pass_samples = guide.enabled()? 1: nsamples;
+
+        for(int done = 0; done < nsamples; pass_samples *= 2){
+            int n = std::min(pass_samples, nsamples - done);
+
+            #pragma omp parallel for schedule(dynamic, 1)  // OpenMP
+            for(int y = 0; y < h; y++){
+                show_progress(y, h-1);
+                for(int x = 0; x < w; x++)
+                    sum[y*w + x] = sum[y*w + x] + sample_sum(x, y, n);
+            }
+
+            done += n;
+            guide.update();
         }
+
+        for(int y = 0; y < h; y++)
+            for(int x = 0; x < w; x++)
+                image(x, y) = toColor(1.0/nsamples*sum[y*w + x]);
     }
 
-    RGB color_at(int x, int y, int nsamples) const{
+    vec3 sample_sum(int x, int y, int nsamples) const{
         vec3 col = {0, 0, 0};
         for(int i = 0; i < nsamples; i++){
             float rx = x + random_value(-0.1, 0.1);
             float ry = y + random_value(-0.1, 0.1);
             Ray ray = camera.ray(rx, ry);
+            #ifdef USE_BIDIRECTIONAL
+            col = col + trace_bidirectional(ray);
+            #else
             col = col + trace_path(ray, 0);
+            #endif
         }
-        return toColor(1.0/nsamples*col);
+        return col;
     }
 
-    vec3 trace_path(Ray ray, int depth) const{
+    // diffuse_bounce: o raio saiu de um rebote difuso, cuja luz direta
+    // já foi estimada por direct_light
+    vec3 trace_path(Ray ray, int depth, bool diffuse_bounce = false) const{
         if(depth > 10)
             return vec3{0, 0, 0};
 
@@ -90,12 +141,21 @@ struct Scene{
 
         IlluminationModel model = get_illumination_model(I.material);
 
+        // emissores são de um lado só, como em LightTree
         if(model == EMISSION)
-            return I.material.Kd;
+            return (!diffuse_bounce && dot(ray.dir, n) < 0)? I.material.Kd: vec3{0, 0, 0};
 
         if(model == DIFFUSE){
-            vec3 dir = cos_random_dir(n);
-            return I.material.Kd*trace_path(Ray{I.position, dir}, depth+1);
+            if(dot(ray.dir, n) > 0)
+                n = -n;
+
+            // final gather: a luz refletida aqui vem do mapa de fótons
+            if(diffuse_bounce && !photon_map.empty())
+                return (1/M_PI)*I.material.Kd*photon_map.irradiance(I.position, n, 100, photon_radius);
+
+            vec3 direct = direct_light(I.position, n);
+            vec3 indirect = guided_bounce(I.position, n, depth);
+            return I.material.Kd*(direct + indirect);
         }
 
         if(model == SPECULAR){
@@ -105,6 +165,388 @@ struct Scene{
 
         return vec3{0, 0, 0};
     }
+
+    // Luz indireta em um ponto difuso, dividida por pi como direct_light.
+    // Sem distribuição aprendida é a amostragem pelo cosseno de sempre.
+    vec3 guided_bounce(vec3 p, vec3 n, int depth) const{
+        const float alpha = 0.5;   // fração das direções tiradas do guia
+        bool guided = guide.trained(p);
+
+        vec3 dir = (guided && random_value(0, 1) < alpha)?
+            guide.sample(p, random_value(0, 1), random_value(0, 1), random_value(0, 1)):
+            cos_random_dir(n);
+
+        float cos_theta = dot(n, dir);
+        if(cos_theta <= 0)
+            return vec3{0, 0, 0};
+
+        float pdf = cos_theta/M_PI;
+        if(guided)
+            pdf = alpha*guide.pdf(p, dir) + (1 - alpha)*pdf;
+
+        vec3 L = trace_path(Ray{p, dir}, depth+1, true);
+        guide.record(p, dir, L, pdf);
+
+        return (cos_theta/(M_PI*pdf))*L;
+    }
+
+    // Luz direta em um ponto difuso, amostrando um emissor pela hierarquia de luzes.
+    // Retorna a irradiância dividida por pi, a ser multiplicada por Kd.
+    vec3 direct_light(vec3 p, vec3 n) const{
+        LightSample s;
+        if(!lights.sample(p, n, random_value(0, 1), random_value(0, 1), random_value(0, 1), s))
+            return vec3{0, 0, 0};
+
+        vec3 d = s.position - p;
+        float d2 = norm2(d);
+        vec3 wi = (1/sqrt(d2))*d;
+
+        float cos_x = dot(n, wi);
+        float cos_y = -dot(s.normal, wi);
+        if(cos_x <= 0 || cos_y <= 0 || occluded(p, s.position))
+            return vec3{0, 0, 0};
+
+        return (cos_x*cos_y/(M_PI*d2*s.pdf))*s.Le;
+    }
+
+    bool occluded(vec3 p, vec3 q) const{
+        MatTriIntersection I = min_intersection(Ray{p, q - p}, meshes);
+        return I.t < 1 - 1e-3;
+    }
+
+    // Pré-passo: emite fótons do céu e dos emissores, com número de fótons
+    // proporcional à potência de cada fonte, e guarda os que chegam em
+    // superfícies difusas
+    void build_photon_map(int nphotons){
+        BoundingBox bounds = scene_bounds();
+        vec3 center = bounds.mid_point();
+        float R = norm(bounds.max() - bounds.min())/2;
+        photon_radius = R/50;
+
+        // o céu entra por um disco de raio R perpendicular à direção sorteada
+        vec3 sky = sky_color();
+        float sky_power = 4*M_PI*M_PI*R*R*(sky[0] + sky[1] + sky[2])/3;
+
+        std::vector<float> cdf = {sky_power};
+        for(size_t i = 0; i < lights.size(); i++)
+            cdf.push_back(cdf.back() + lights.get_emitter(i).power);
+        float total = cdf.back();
+
+        std::vector<Photon> photons;
+        for(int i = 0; i < nphotons; i++){
+            float u = random_value(0, total);
+            int j = std::upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+            j = std::min(j, (int)cdf.size()-1);
+            float p = (cdf[j] - (j > 0? cdf[j-1]: 0))/total;
+
+            Ray ray;
+            vec3 power;
+            if(j == 0){
+                vec3 w = uniform_random_dir();
+                vec3 a = normalize( cross((fabsf(w[0]) > .1 ? vec3{0, 1, 0} : vec3{1, 0, 0}), w) );
+                vec3 b = cross(w, a);
+                float r = R*sqrt(random_value(0, 1));
+                float phi = random_value(0, 2*M_PI);
+                ray = Ray{center + R*w + r*cos(phi)*a + r*sin(phi)*b, -w};
+                power = (4*M_PI*M_PI*R*R/(p*nphotons))*sky;
+            }else{
+                const Emitter& E = lights.get_emitter(j-1);
+                vec3 Le;
+                E.sample(random_value(0, 1), random_value(0, 1), ray.orig, Le);
+                ray.dir = cos_random_dir(E.normal);
+                power = (M_PI*E.area/(p*nphotons))*Le;
+            }
+            trace_photon(ray, power, photons);
+        }
+        photon_map = PhotonMap{photons};
+    }
+
+    void trace_photon(Ray ray, vec3 power, std::vector<Photon>& photons) const{
+        for(int depth = 0; depth <= 10; depth++){
+            MatTriIntersection I = min_intersection(ray, meshes);
+            if(I.t == HUGE_VALF)
+                return;
+
+            vec3 n = normalize(I.normal);
+            vec3 dir = normalize(ray.dir);
+            sample_textures(I.material, I.texCoords);
+
+            IlluminationModel model = get_illumination_model(I.material);
+
+            if(model == EMISSION)
+                return;
+
+            if(model == SPECULAR){
+                power = I.material.Ks*power;
+                ray = Ray{I.position, reflect(dir, n)};
+                continue;
+            }
+
+            photons.push_back({I.position, power, dir});
+            if(dot(dir, n) > 0)
+                n = -n;
+
+            // roleta russa
+            vec3 Kd = I.material.Kd;
+            float q = std::min(1.0f, std::max({Kd[0], Kd[1], Kd[2]}));
+            if(random_value(0, 1) >= q)
+                return;
+
+            power = (1/q)*(Kd*power);
+            ray = Ray{I.position, cos_random_dir(n)};
+        }
+    }
+
+    /**************************** BIDIRECIONAL *****************************/
+    static const int max_depth = 10;
+
+    struct PathVertex{
+        vec3 p;
+        vec3 n;                 // normal voltada para o lado de onde o caminho chegou
+        vec3 beta;              // throughput do subcaminho até o vértice
+        vec3 Kd;
+        vec3 Le;                // radiância emitida na direção de chegada
+        IlluminationModel model = DIFFUSE;
+        bool camera = false;
+        bool light = false;     // origem do subcaminho de luz
+        float origin_pdf = 0;   // densidade de escolher este ponto como origem de luz
+        float pdf_fwd = 0;      // densidade (em área) com que o subcaminho gerou o vértice
+        float pdf_rev = 0;      // densidade (em área) se fosse gerado pelo outro subcaminho
+
+        bool delta() const{ return !camera && !light && model == SPECULAR; }
+        bool connectible() const{ return light || (!camera && model == DIFFUSE); }
+    };
+
+    vec3 trace_bidirectional(Ray ray) const{
+        std::vector<PathVertex> C, L;
+
+        PathVertex cam;
+        cam.camera = true;
+        cam.p = ray.orig;
+        C.push_back(cam);
+        vec3 sky = random_walk(ray, vec3{1, 1, 1}, 1, max_depth+2, C)*sky_color();
+
+        light_subpath(L);
+
+        // caminhos que escapam para o céu só são gerados pela câmera: peso 1
+        vec3 col = sky;
+        for(int t = 2; t <= (int)C.size(); t++)
+            for(int s = 0; s <= (int)L.size() && s + t - 2 <= max_depth; s++)
+                col = col + connect(L, C, s, t);
+        return col;
+    }
+
+    void light_subpath(std::vector<PathVertex>& path) const{
+        float pmf;
+        int e = lights.sample_by_power(random_value(0, 1), pmf);
+        if(e < 0)
+            return;
+
+        const Emitter& E = lights.get_emitter(e);
+        PathVertex v;
+        v.light = true;
+        v.n = E.normal;
+        E.sample(random_value(0, 1), random_value(0, 1), v.p, v.Le);
+        v.origin_pdf = v.pdf_fwd = pmf/E.area;
+        v.beta = (1/v.pdf_fwd)*v.Le;
+        path.push_back(v);
+
+        // direção ponderada pelo cosseno: Le cos/(pdf_pos pdf_dir) = pi Le/pdf_pos
+        vec3 dir = cos_random_dir(E.normal);
+        random_walk(Ray{v.p, dir}, (M_PI/v.pdf_fwd)*v.Le, dot(E.normal, dir)/M_PI, max_depth+1, path);
+    }
+
+    // Estende o subcaminho até max_vertices vértices.
+    // Retorna o throughput do raio que escapou para o céu (zero se não escapou).
+    vec3 random_walk(Ray ray, vec3 beta, float pdf_dir, int max_vertices, std::vector<PathVertex>& path) const{
+        while((int)path.size() < max_vertices){
+            MatTriIntersection I = min_intersection(ray, meshes);
+            if(I.t == HUGE_VALF)
+                return beta;
+
+            PathVertex v;
+            v.p = I.position;
+            v.n = normalize(I.normal);
+            bool front = dot(ray.dir, v.n) < 0;
+            if(!front)
+                v.n = -v.n;
+
+            float radiance = (I.material.Kd[0] + I.material.Kd[1] + I.material.Kd[2])/3;
+            sample_textures(I.material, I.texCoords);
+            v.model = get_illumination_model(I.material);
+            v.Kd = I.material.Kd;
+            v.beta = beta;
+            v.pdf_fwd = to_area(pdf_dir, path.back(), v);
+
+            if(v.model == EMISSION){
+                v.Le = front? I.material.Kd: vec3{0, 0, 0};
+                v.origin_pdf = M_PI*radiance/lights.total_power();
+                path.push_back(v);
+                break;
+            }
+            path.push_back(v);
+
+            vec3 wo = -normalize(ray.dir);
+            vec3 dir;
+            float pdf_rev;
+            if(v.model == DIFFUSE){
+                dir = cos_random_dir(v.n);
+                pdf_dir = dot(v.n, dir)/M_PI;
+                pdf_rev = dot(v.n, wo)/M_PI;
+                beta = v.Kd*beta;
+            }else{
+                dir = reflect(-wo, v.n);
+                pdf_dir = pdf_rev = 0;
+                beta = I.material.Ks*beta;
+            }
+
+            PathVertex& prev = path[path.size()-2];
+            prev.pdf_rev = to_area(pdf_rev, v, prev);
+            ray = Ray{v.p, dir};
+        }
+        return vec3{0, 0, 0};
+    }
+
+    // Contribuição da estratégia com s vértices de luz e t vértices da câmera
+    vec3 connect(std::vector<PathVertex>& L, std::vector<PathVertex>& C, int s, int t) const{
+        const PathVertex& pt = C[t-1];
+        PathVertex sampled;
+        vec3 col;
+
+        if(s == 0){
+            if(pt.model != EMISSION)
+                return vec3{0, 0, 0};
+            col = pt.beta*pt.Le;
+        }else if(s == 1){
+            // luz direta amostrada pela hierarquia de luzes
+            LightSample ls;
+            if(!pt.connectible() || !lights.sample(pt.p, pt.n, random_value(0, 1), random_value(0, 1), random_value(0, 1), ls))
+                return vec3{0, 0, 0};
+
+            // para o MIS, a densidade é a de origem de um subcaminho de luz
+            const Emitter& E = lights.get_emitter(ls.emitter);
+            sampled.light = true;
+            sampled.p = ls.position;
+            sampled.n = ls.normal;
+            sampled.Le = ls.Le;
+            sampled.origin_pdf = sampled.pdf_fwd = E.power/(E.area*lights.total_power());
+
+            vec3 d = sampled.p - pt.p;
+            float d2 = norm2(d);
+            float cos_l = -dot(sampled.n, d)/sqrt(d2);
+            float cos_t = dot(pt.n, d)/sqrt(d2);
+            if(cos_l <= 0 || cos_t <= 0)
+                return vec3{0, 0, 0};
+            col = (cos_l*cos_t/(d2*ls.pdf))*(pt.beta*bsdf(pt, sampled)*sampled.Le);
+        }else{
+            const PathVertex& qs = L[s-1];
+            if(!pt.connectible() || !qs.connectible())
+                return vec3{0, 0, 0};
+            col = geometry(qs, pt)*(qs.beta*bsdf(qs, pt)*bsdf(pt, qs)*pt.beta);
+        }
+
+        if(col[0] + col[1] + col[2] <= 0)
+            return vec3{0, 0, 0};
+
+        if(s > 0 && occluded(pt.p, s == 1? sampled.p: L[s-1].p))
+            return vec3{0, 0, 0};
+
+        return mis_weight(L, C, s, t, sampled)*col;
+    }
+
+    // Balance heuristic calculada pelas razões entre densidades ao
+    // deslocar o ponto de conexão ao longo do caminho.
+    // A estratégia com t = 1 (ligar o subcaminho de luz à câmera) não é usada.
+    float mis_weight(std::vector<PathVertex>& L, std::vector<PathVertex>& C, int s, int t, const PathVertex& sampled) const{
+        if(s + t == 2)
+            return 1;
+
+        std::vector<PathVertex> light = std::vector<PathVertex>(L.begin(), L.begin()+s);
+        if(s == 1)
+            light[0] = sampled;
+
+        PathVertex* qs = s > 0? &light[s-1]: nullptr;
+        PathVertex* qsMinus = s > 1? &light[s-2]: nullptr;
+        PathVertex& pt = C[t-1];
+        PathVertex& ptMinus = C[t-2];
+
+        float pt_rev = pt.pdf_rev;
+        float ptMinus_rev = ptMinus.pdf_rev;
+
+        pt.pdf_rev = qs? pdf_area(*qs, pt): pt.origin_pdf;
+        ptMinus.pdf_rev = pdf_area(pt, ptMinus);
+        if(qs)
+            qs->pdf_rev = pdf_area(pt, *qs);
+        if(qsMinus)
+            qsMinus->pdf_rev = pdf_area(*qs, *qsMinus);
+
+        auto remap = [](float f){ return f != 0? f: 1; };
+
+        float sum = 0;
+        float ri = 1;
+        for(int i = t-1; i > 1; i--){
+            ri *= remap(C[i].pdf_rev)/remap(C[i].pdf_fwd);
+            if(!C[i].delta() && !C[i-1].delta())
+                sum += ri;
+        }
+
+        ri = 1;
+        for(int i = s-1; i >= 0; i--){
+            ri *= remap(light[i].pdf_rev)/remap(light[i].pdf_fwd);
+            bool delta_prev = i > 0 && light[i-1].delta();
+            if(!light[i].delta() && !delta_prev)
+                sum += ri;
+        }
+
+        pt.pdf_rev = pt_rev;
+        ptMinus.pdf_rev = ptMinus_rev;
+
+        return 1/(1 + sum);
+    }
+
+    // Converte densidade em ângulo sólido, vista de from, para densidade em área em to
+    static float to_area(float pdf, const PathVertex& from, const PathVertex& to){
+        vec3 d = to.p - from.p;
+        float d2 = norm2(d);
+        if(d2 == 0)
+            return 0;
+        if(!to.camera)
+            pdf *= fabs(dot(to.n, d))/sqrt(d2);
+        return pdf/d2;
+    }
+
+    // Densidade (em área) de v amostrar next: cosseno para difusos e emissores
+    static float pdf_area(const PathVertex& v, const PathVertex& next){
+        if(v.camera || v.delta())
+            return 0;
+        vec3 w = normalize(next.p - v.p);
+        return to_area(std::max(0.0f, dot(v.n, w))/M_PI, v, next);
+    }
+
+    static vec3 bsdf(const PathVertex& v, const PathVertex& next){
+        if(v.model != DIFFUSE || v.light || dot(v.n, next.p - v.p) <= 0)
+            return vec3{0, 0, 0};
+        return (1/M_PI)*v.Kd;
+    }
+
+    float geometry(const PathVertex& a, const PathVertex& b) const{
+        vec3 d = b.p - a.p;
+        float d2 = norm2(d);
+        vec3 w = (1/sqrt(d2))*d;
+        return fabs(dot(a.n, w))*fabs(dot(b.n, w))/d2;
+    }
+
+    BoundingBox scene_bounds() const{
+        BoundingBox bounds;
+        for(const RTMesh& mesh: meshes){
+            mat4 M = mesh.get_model_matrix();
+            for(const MeshRange& range: mesh.get_ranges())
+                for(const ObjTriangle& tri: range.get_triangles())
+                    for(const ObjVertex& v: tri)
+                        bounds.add(toVec3(M*toVec4(v.position, 1)));
+        }
+        return bounds;
+    }
 };
 
 MaterialInfo get_material(int illum, vec3 Kd, vec3 Ks=vec3{0,0,0}){
@@ -139,6 +581,16 @@ int main(){
         get_meshes()
     };
     scene.camera.lookAt({10, 7, 15}, {0, 4, 0}, {0, 1, 0});
+    scene.lights = LightTree{get_emitters(scene.meshes)};
+
+    #ifdef USE_PHOTON_MAP
+    scene.build_photon_map(500000);
+    #endif
+
+    #ifdef USE_PATH_GUIDING
+    BoundingBox bounds = scene.scene_bounds();
+    scene.guide = GuidingField{norm(bounds.max() - bounds.min())/64};
+    #endif
 
 	auto start = std::chrono::high_resolution_clock::now();
 	scene.render(nsamples);
@@ -3,6 +3,13 @@
 
 #include <algorithm>
 #include <cmath>
+#include <climits>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "vec.h"
 #include "geometry.h"
 
@@ -20,21 +27,38 @@ inline vec2 toVec2(Pixel p){
 	return {(float)p.x, (float)p.y};
 }
 
+// Região [x0, x1) x [y0, y1) à qual a rasterização fica restrita
+struct Scissor{
+	int x0, y0, x1, y1;
+};
+
+const Scissor no_scissor = {INT_MIN, INT_MIN, INT_MAX, INT_MAX};
+
+// As funções de rasterização têm duas formas: uma que chama f(Pixel) para
+// cada pixel gerado (sem alocação) e outra que devolve os pixels num vetor.
+
 //////////////////////////////////////////////////////////////////////////////
 
-template<class Line>
-std::vector<Pixel> rasterizeLine(const Line& P){
-	//return simple(P[0], P[1]);
+template<class Line, class F>
+void rasterizeLine(const Line& P, F f){
+	//simple(P[0], P[1], f);
 
-	return dda(P[0], P[1]);
+	dda(P[0], P[1], f);
+
+	//bresenham(toPixel(P[0]), toPixel(P[1]), f);
+}
 
-	//return bresenham(toPixel(P[0]), toPixel(P[1]));
+template<class Line>
+std::vector<Pixel> rasterizeLine(const Line& P){
+	std::vector<Pixel> out;
+	rasterizeLine(P, [&](Pixel p){ out.push_back(p); });
+	return out;
 }
 
 //////////////////////////////////////////////////////////////////////////////
 
-inline std::vector<Pixel> simple(vec2 A, vec2 B){
-	std::vector<Pixel> out;
+template<class F>
+void simple(vec2 A, vec2 B, F f){
 	vec2 d = B - A;
 	float m = d[1]/d[0];
 	float b = A[1] - m*A[0];
@@ -44,83 +68,226 @@ inline std::vector<Pixel> simple(vec2 A, vec2 B){
 
 	for(int x = x0; x <= x1; x++){
 		int y = (int)roundf(m*x + b);
-		out.push_back({x, y});
+		f(Pixel{x, y});
 	}
+}
+
+inline std::vector<Pixel> simple(vec2 A, vec2 B){
+	std::vector<Pixel> out;
+	simple(A, B, [&](Pixel p){ out.push_back(p); });
 	return out;
 }
 
 //////////////////////////////////////////////////////////////////////////////
 
-inline std::vector<Pixel> dda(vec2 A, vec2 B){
+template<class F>
+void dda(vec2 A, vec2 B, F f){
 	vec2 dif = B - A;
 	float delta = std::max(fabs(dif[0]), fabs(dif[1]));
 
 	vec2 d = (1/delta)*dif;
 	vec2 p = A;
 
-	std::vector<Pixel> out;
 	for(int i = 0; i <= delta; i++){
-		out.push_back(toPixel(p));
+		f(toPixel(p));
 		p = p + d;
 	}
+}
+
+inline std::vector<Pixel> dda(vec2 A, vec2 B){
+	std::vector<Pixel> out;
+	dda(A, B, [&](Pixel p){ out.push_back(p); });
 	return out;
 }
 
 //////////////////////////////////////////////////////////////////////////////
 
-inline std::vector<Pixel> bresenham_base(int dx, int dy){
-	std::vector<Pixel> out;
-
-	int D = 2*dy - dx; 
+template<class F>
+void bresenham_base(int dx, int dy, F f){
+	int D = 2*dy - dx;
 	int y = 0;
 	for(int x = 0; x <= dx; x++){
-		out.push_back({x, y});
+		f(Pixel{x, y});
 		if(D > 0){
 			y++;
 			D -= 2*dx;
 		}
 		D += 2*dy;
 	}
+}
+
+template<class F>
+void bresenham(int dx, int dy, F f){
+	if(dx >= dy)
+		bresenham_base(dx, dy, f);
+	else
+		bresenham_base(dy, dx, [&](Pixel p){ f(Pixel{p.y, p.x}); });
+}
+
+template<class F>
+void bresenham(Pixel p0, Pixel p1, F f){
+	if(p0.x > p1.x)
+		std::swap(p0, p1);
+
+	int s = (p0.y <= p1.y)? 1: -1;
+
+	bresenham(p1.x - p0.x, abs(p1.y - p0.y), [&](Pixel p){
+		f(Pixel{p0.x + p.x, p0.y + s*p.y});
+	});
+}
+
+inline std::vector<Pixel> bresenham_base(int dx, int dy){
+	std::vector<Pixel> out;
+	bresenham_base(dx, dy, [&](Pixel p){ out.push_back(p); });
 	return out;
 }
 
 inline std::vector<Pixel> bresenham(int dx, int dy){
 	std::vector<Pixel> out;
-
-	if(dx >= dy){
-		out = bresenham_base(dx, dy);
-	}else{
-		out = bresenham_base(dy, dx);
-		for(Pixel& p: out)
-			p = {p.y, p.x};
-	}
+	bresenham(dx, dy, [&](Pixel p){ out.push_back(p); });
 	return out;
 }
 
 inline std::vector<Pixel> bresenham(Pixel p0, Pixel p1){
-	if(p0.x > p1.x)
-		std::swap(p0, p1);
+	std::vector<Pixel> out;
+	bresenham(p0, p1, [&](Pixel p){ out.push_back(p); });
+	return out;
+}
 
-	std::vector<Pixel> out = bresenham(p1.x - p0.x, abs(p1.y - p0.y));
+//////////////////////////////////////////////////////////////////////////////
+// Linhas com passo inteiro no eixo principal (x, ou y se a linha for mais
+// vertical): um pixel por coluna entre as extremidades arredondadas, com o
+// eixo secundário e o parâmetro t (0 em A, 1 em B) atualizados por
+// incremento. O intervalo do eixo principal é recortado por S antes do laço.
+
+struct LineSetup{
+	bool steep;      // eixo principal é y
+	int i0, i1;      // intervalo do eixo principal, já recortado
+	int j0, j1;      // intervalo [j0, j1) do eixo secundário dentro de S
+	float v, dv;     // eixo secundário em i0 e passo
+	float t, dt;     // parâmetro em i0 e passo
+	float a, b;      // extremidades no eixo principal (a <= b)
+
+	// Retorna false se nada da linha cai em S. Um segmento de comprimento
+	// nulo fica com dv = dt = 0.
+	bool init(vec2 A, vec2 B, Scissor S){
+		steep = fabs(B[1] - A[1]) > fabs(B[0] - A[0]);
+		int ax = steep, ay = !steep;
+
+		float t0 = 0, sign = 1;
+		if(A[ax] > B[ax]){
+			std::swap(A, B);
+			t0 = 1;
+			sign = -1;
+		}
+		a = A[ax];
+		b = B[ax];
 
-	int s = (p0.y <= p1.y)? 1: -1;
+		float d = b - a;
+		dv = d > 0? (B[ay] - A[ay])/d: 0;
+		dt = d > 0? sign/d: 0;
 
-	for(Pixel& p: out)
-		p = {p0.x + p.x, p0.y + s*p.y};
+		i0 = std::max((int)round(a), steep? S.y0: S.x0);
+		i1 = std::min((int)round(b), (steep? S.y1: S.x1) - 1);
+		j0 = steep? S.x0: S.y0;
+		j1 = steep? S.x1: S.y1;
 
-	return out;
+		v = A[ay] + (i0 - a)*dv;
+		t = t0 + (i0 - a)*dt;
+		return i0 <= i1;
+	}
+
+	Pixel pixel(int i, int j) const{
+		return steep? Pixel{j, i}: Pixel{i, j};
+	}
+};
+
+// Chama f(Pixel, t) para cada pixel da linha AB dentro de S.
+// O eixo secundário anda em ponto fixo 16.16.
+template<class F>
+void rasterizeLineSpan(vec2 A, vec2 B, Scissor S, F f){
+	LineSetup L;
+	if(!L.init(A, B, S))
+		return;
+
+	int64_t v = llround((L.v + 0.5)*65536);
+	int64_t dv = llround(L.dv*65536);
+	float t = L.t;
+	for(int i = L.i0; i <= L.i1; i++, v += dv, t += L.dt){
+		int j = (int)(v >> 16);
+		if(j >= L.j0 && j < L.j1)
+			f(L.pixel(i, j), std::clamp(t, 0.0f, 1.0f));
+	}
+}
+
+// Linha anti-serrilhada (Xiaolin Wu): em cada passo do eixo principal, os
+// dois pixels vizinhos no eixo secundário dividem a cobertura conforme a
+// distância ao centro; nas extremidades ela é multiplicada pela fração do
+// pixel coberta pelo segmento. Chama f(Pixel, t, cobertura) dentro de S.
+template<class F>
+void rasterizeLineAA(vec2 A, vec2 B, Scissor S, F f){
+	LineSetup L;
+	if(!L.init(A, B, S))
+		return;
+
+	float v = L.v;
+	float t = L.t;
+	for(int i = L.i0; i <= L.i1; i++, v += L.dv, t += L.dt){
+		float gap = 1;
+		if(i - 0.5f < L.a || i + 0.5f > L.b)
+			gap = std::clamp(std::min(i + 0.5f, L.b) - std::max(i - 0.5f, L.a), 0.0f, 1.0f);
+		if(L.a == L.b)
+			gap = 1;
+
+		int j = (int)floor(v);
+		float frac = v - j;
+		float tc = std::clamp(t, 0.0f, 1.0f);
+		if(j >= L.j0 && j < L.j1 && frac < 1)
+			f(L.pixel(i, j), tc, (1 - frac)*gap);
+		if(j + 1 >= L.j0 && j + 1 < L.j1 && frac > 0)
+			f(L.pixel(i, j + 1), tc, frac*gap);
+	}
 }
 
 //////////////////////////////////////////////////////////////////////////////
 
-template<class Tri>
-std::vector<Pixel> rasterizeTriangle(const Tri& P){
-	return simple_rasterize_triangle(P);
-	//return scanline(P);
+// Trechos horizontais: span(y, x0, x1) para cada trecho [x0, x1) do triângulo
+template<class Tri, class F>
+void rasterizeTriangleSpans(const Tri& P, Scissor S, F span){
+	edge_rasterize_triangle(P, S, span);
+	//scanline(P, S, span);
+}
+
+// Idem, com teste por bloco de 8x8 alinhado (ver edge_rasterize_triangle)
+template<class Tri, class F, class B>
+void rasterizeTriangleSpans(const Tri& P, Scissor S, F span, B block){
+	edge_rasterize_triangle(P, S, span, block);
+}
+
+// Quads 2x2 alinhados: quad(x, y, mask) (ver edge_rasterize_quads)
+template<class Tri, class Q, class B>
+void rasterizeTriangleQuads(const Tri& P, Scissor S, Q quad, B block){
+	edge_rasterize_quads(P, S, quad, block);
+}
+
+template<class Tri, class F>
+void rasterizeTriangle(const Tri& P, Scissor S, F f){
+	//simple_rasterize_triangle(P, S, f);
+	rasterizeTriangleSpans(P, S, [&](int y, int x0, int x1){
+		for(int x = x0; x < x1; x++)
+			f(Pixel{x, y});
+	});
 }
 
 template<class Tri>
-std::vector<Pixel> simple_rasterize_triangle(const Tri& P){
+std::vector<Pixel> rasterizeTriangle(const Tri& P, Scissor S = no_scissor){
+	std::vector<Pixel> out;
+	rasterizeTriangle(P, S, [&](Pixel p){ out.push_back(p); });
+	return out;
+}
+
+template<class Tri, class F>
+void simple_rasterize_triangle(const Tri& P, Scissor S, F f){
 	vec2 A = P[0];
 	vec2 B = P[1];
 	vec2 C = P[2];
@@ -130,54 +297,64 @@ std::vector<Pixel> simple_rasterize_triangle(const Tri& P){
 	int ymin =  ceil(std::min({A[1], B[1], C[1]}));
 	int ymax = floor(std::max({A[1], B[1], C[1]}));
 
-	std::vector<Pixel> out;
+	xmin = std::max(xmin, S.x0);
+	xmax = std::min(xmax, S.x1-1);
+	ymin = std::max(ymin, S.y0);
+	ymax = std::min(ymax, S.y1-1);
+
 	Pixel p;
 	for(p.y = ymin; p.y <= ymax; p.y++)
 		for(p.x = xmin; p.x <= xmax; p.x++)
 			if(is_inside(toVec2(p), P))
-				out.push_back(p);
+				f(p);
+}
+
+template<class Tri>
+std::vector<Pixel> simple_rasterize_triangle(const Tri& P, Scissor S = no_scissor){
+	std::vector<Pixel> out;
+	simple_rasterize_triangle(P, S, [&](Pixel p){ out.push_back(p); });
 	return out;
 }
 
+// Área nula: o triângulo é um segmento ou um ponto (mesmo critério de is_inside)
 template<class Tri>
 bool isDegenerated(const Tri& P){
-	return P[0]==P[1] && P[1]==P[2] && P[2]==P[0];
+	return fabs(tri_area(P[0], P[1], P[2])) < 1e-5;
 }
 
-bool isCrossing(vec2 A, vec2 B, int y){// Se os pontos cruzarem a reta
+inline bool isCrossing(vec2 A, vec2 B, int y){// Se os pontos cruzarem a reta
 	return (B[1]>=y && A[1]<=y) || (B[1]<=y && A[1]>=y);
 }
 
-float calcX(vec2 A, vec2 B, int y){
+inline float calcX(vec2 A, vec2 B, int y){
 	return (((B[0]-A[0])*(y-A[1]))/(B[1]-A[1])) + A[0];
 }
 
-vec2 intersecs(vec2 A, vec2 B, vec2 C, int y){
-	std::vector<float> xs;
-
-	if(isCrossing(A, B, y)){
-		float x = calcX(A, B, y);
-		xs.push_back(x);
-	}
-	if(isCrossing(B, C, y)){
-		float x = calcX(B, C, y);
-		xs.push_back(x);
-	}
-	if(isCrossing(C, A, y)){
-		float x = calcX(C, A, y);
-		xs.push_back(x);
+// Intervalo [xmin, xmax] de pixels da linha y dentro do triângulo.
+// Arestas horizontais são ignoradas: seus extremos já são pegos pelas outras duas.
+inline vec2 intersecs(vec2 A, vec2 B, vec2 C, int y){
+	vec2 E[][2] = { {A, B}, {B, C}, {C, A} };
+
+	float xmin = INFINITY, xmax = -INFINITY;
+	for(auto& e: E){
+		if(e[0][1] != e[1][1] && isCrossing(e[0], e[1], y)){
+			float x = calcX(e[0], e[1], y);
+			xmin = std::min(xmin, x);
+			xmax = std::max(xmax, x);
+		}
 	}
 
-	float xmin =  ceil(*std::min_element(xs.begin(), xs.end())),
-		  xmax = floor(*std::max_element(xs.begin(), xs.end()));
-
-	return {xmin, xmax};
+	return {ceilf(xmin), floorf(xmax)};
 }
 
-template<class Tri>
-std::vector<Pixel> scanline(const Tri& P){
-	if (isDegenerated(P))
-		return {};
+// Chama span(y, x0, x1) para cada trecho horizontal [x0, x1) do triângulo na linha y
+template<class Tri, class F>
+void scanline(const Tri& P, Scissor S, F span){
+	if(isDegenerated(P)){
+		// segmentos e pontos seguem a regra de is_inside
+		simple_rasterize_triangle(P, S, [&](Pixel p){ span(p.y, p.x, p.x+1); });
+		return;
+	}
 
 	vec2 A = P[0];
 	vec2 B = P[1];
@@ -185,15 +362,348 @@ std::vector<Pixel> scanline(const Tri& P){
 	int ymin = 	ceil(std::min({A[1], B[1], C[1]})),
 		ymax = floor(std::max({A[1], B[1], C[1]}));
 
-	std::vector<Pixel> out;
-	for(int y = ymin; y <= ymax; y++){
+	ymin = std::max(ymin, S.y0);
+	ymax = std::min(ymax, S.y1-1);
 
+	for(int y = ymin; y <= ymax; y++){
 		vec2 xs = intersecs(A, B, C, y);
 
-		for(int x = xs[0]; x <= xs[1]; x++)
-			out.push_back({x, y});
+		int x0 = std::max((int)xs[0], S.x0);
+		int x1 = std::min((int)xs[1], S.x1-1);
+		if(x0 <= x1)
+			span(y, x0, x1+1);
+	}
+}
+
+template<class Tri>
+std::vector<Pixel> scanline(const Tri& P, Scissor S = no_scissor){
+	std::vector<Pixel> out;
+	scanline(P, S, [&](int y, int x0, int x1){
+		size_t n = out.size();
+		out.resize(n + x1 - x0);
+		for(int x = x0; x < x1; x++)
+			out[n++] = {x, y};
+	});
+	return out;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Rasterização por funções de aresta em ponto fixo (4 bits de subpixel).
+// A caixa envolvente é percorrida em blocos de 8x8: blocos totalmente fora
+// são descartados, blocos totalmente dentro viram trechos inteiros e só os
+// parciais são avaliados pixel a pixel (4 pixels por instrução com SSE2).
+// Regra top-left: um pixel exatamente sobre a aresta comum a dois
+// triângulos é gerado por apenas um deles. Triângulos de área nula não
+// geram pixels.
+
+// E(x, y) = A*x + B*y + C, em unidades de 1/256 de pixel², avaliada nos
+// centros dos pixels (coordenadas inteiras); E >= 0 do lado de dentro
+struct EdgeFunction{
+	int64_t A, B, C;
+
+	int64_t at(int64_t x, int64_t y) const{
+		return A*x + B*y + C;
+	}
+};
+
+inline int64_t floor_div(int64_t a, int64_t b){
+	return a >= 0? a/b: -((-a + b - 1)/b);
+}
+
+// Máscara (bit c = coluna c) dos pixels de uma linha de bloco dentro do triângulo.
+// e0 é o valor de cada aresta no primeiro pixel da linha.
+inline unsigned int row_coverage(const EdgeFunction* E, const int64_t* e0){
+	unsigned int mask = 0;
+	for(int c = 0; c < 8; c++)
+		if(e0[0] + c*E[0].A >= 0 && e0[1] + c*E[1].A >= 0 && e0[2] + c*E[2].A >= 0)
+			mask |= 1u << c;
+	return mask;
+}
+
+// Cobertura de um bloco parcial: mask[r] para cada uma das 8 linhas.
+// e é o valor das arestas no canto (bx, by); inside[k] indica arestas que
+// não cruzam o bloco e portanto não precisam ser testadas.
+inline void block_coverage(const EdgeFunction* E, const int64_t* e, const bool* inside, bool fits32, unsigned int* mask){
+#ifdef __SSE2__
+	if(fits32){
+		// arestas que cruzam o bloco têm |E| < 2^31 nele; as demais contribuem com 0
+		__m128i lo[3], hi[3], step[3];
+		for(int k = 0; k < 3; k++){
+			int32_t v = inside[k]? 0: (int32_t)e[k];
+			int32_t a = inside[k]? 0: (int32_t)E[k].A;
+			int32_t b = inside[k]? 0: (int32_t)E[k].B;
+			lo[k] = _mm_setr_epi32(v, v + a, v + 2*a, v + 3*a);
+			hi[k] = _mm_add_epi32(lo[k], _mm_set1_epi32(4*a));
+			step[k] = _mm_set1_epi32(b);
+		}
+		for(int r = 0; r < 8; r++){
+			// pixel fora se alguma aresta for negativa: basta o bit de sinal do OR
+			__m128i l = _mm_or_si128(_mm_or_si128(lo[0], lo[1]), lo[2]);
+			__m128i h = _mm_or_si128(_mm_or_si128(hi[0], hi[1]), hi[2]);
+			int out = _mm_movemask_ps(_mm_castsi128_ps(l)) | (_mm_movemask_ps(_mm_castsi128_ps(h)) << 4);
+			mask[r] = ~out & 0xFF;
+			for(int k = 0; k < 3; k++){
+				lo[k] = _mm_add_epi32(lo[k], step[k]);
+				hi[k] = _mm_add_epi32(hi[k], step[k]);
+			}
+		}
+		return;
+	}
+#endif
+	int64_t row[3] = {e[0], e[1], e[2]};
+	for(int r = 0; r < 8; r++){
+		mask[r] = row_coverage(E, row);
+		for(int k = 0; k < 3; k++)
+			row[k] += E[k].B;
+	}
+}
+
+// Chama span(y, x0, x1) para cada trecho horizontal [x0, x1) do triângulo.
+// Os trechos de linhas diferentes podem vir intercalados.
+template<class Tri, class F>
+void edge_rasterize_triangle(const Tri& P, Scissor S, F span){
+	edge_rasterize_triangle(P, S, span, [](int, int){ return true; });
+}
+
+// Funções de aresta do triângulo, com E >= 0 do lado de dentro e a regra
+// top-left já incluída em C. X, Y recebem os vértices em 1/16 de pixel.
+// Retorna false se o triângulo tiver área nula.
+template<class Tri>
+bool edge_functions(const Tri& P, int64_t* X, int64_t* Y, EdgeFunction* E){
+	for(int i = 0; i < 3; i++){
+		vec2 v = P[i];
+		X[i] = llround(v[0]*16);
+		Y[i] = llround(v[1]*16);
+	}
+
+	int64_t area = (X[1]-X[0])*(Y[2]-Y[0]) - (Y[1]-Y[0])*(X[2]-X[0]);
+	if(area == 0)
+		return false;
+	if(area < 0){
+		std::swap(X[1], X[2]);
+		std::swap(Y[1], Y[2]);
+	}
+
+	for(int i = 0; i < 3; i++){
+		int j = (i+1)%3;
+		int64_t dx = X[j] - X[i];
+		int64_t dy = Y[j] - Y[i];
+		bool top_left = dy < 0 || (dy == 0 && dx < 0);
+		E[i].A = -16*dy;
+		E[i].B =  16*dx;
+		E[i].C = dy*X[i] - dx*Y[i] - (top_left? 0: 1);
+	}
+	return true;
+}
+
+// Percorre os blocos 8x8 alinhados que tocam o triângulo, faixa por faixa
+// de 8 linhas, chamando cover(bx, by, mask) para cada bloco com pixels
+// cobertos: mask[r] tem o bit c ligado se o pixel (bx + c, by + r) estiver
+// no triângulo e dentro de S. block(bx, by) é consultado antes de cada
+// bloco; se retornar false o bloco é descartado (ex.: oclusão).
+template<class Tri, class B, class C>
+void edge_rasterize_blocks(const Tri& P, Scissor S, B block, C cover){
+	int64_t X[3], Y[3];
+	EdgeFunction E[3];
+	if(!edge_functions(P, X, Y, E))
+		return;
+
+	int xmin = std::max<int64_t>(S.x0, -floor_div(-std::min({X[0], X[1], X[2]}), 16));
+	int ymin = std::max<int64_t>(S.y0, -floor_div(-std::min({Y[0], Y[1], Y[2]}), 16));
+	int xmax = std::min<int64_t>(S.x1-1, floor_div(std::max({X[0], X[1], X[2]}), 16));
+	int ymax = std::min<int64_t>(S.y1-1, floor_div(std::max({Y[0], Y[1], Y[2]}), 16));
+	if(xmin > xmax || ymin > ymax)
+		return;
+
+	bool fits32 = true;
+	for(int k = 0; k < 3; k++)
+		fits32 = fits32 && std::abs(E[k].A) + std::abs(E[k].B) < (int64_t{1} << 27);
+
+	// extremos de cada aresta num bloco, relativos ao canto
+	int64_t dmin[3], dmax[3];
+	for(int k = 0; k < 3; k++){
+		dmin[k] = std::min<int64_t>(0, 7*E[k].A) + std::min<int64_t>(0, 7*E[k].B);
+		dmax[k] = std::max<int64_t>(0, 7*E[k].A) + std::max<int64_t>(0, 7*E[k].B);
+	}
+
+	for(int by = ymin & ~7; by <= ymax; by += 8){
+		unsigned int rows = 0;
+		for(int r = 0; r < 8; r++)
+			if(by + r >= ymin && by + r <= ymax)
+				rows |= 1u << r;
+
+		for(int bx = xmin & ~7; bx <= xmax; bx += 8){
+			int64_t e[3];
+			bool inside[3];
+			bool reject = false;
+			bool accept = true;
+			for(int k = 0; k < 3; k++){
+				e[k] = E[k].at(bx, by);
+				inside[k] = e[k] + dmin[k] >= 0;
+				accept = accept && inside[k];
+				reject = reject || e[k] + dmax[k] < 0;
+			}
+			if(reject || !block(bx, by))
+				continue;
+
+			unsigned int cols = 0xFF;
+			if(bx < xmin)
+				cols &= 0xFF << (xmin - bx);
+			if(bx + 7 > xmax)
+				cols &= 0xFF >> (bx + 7 - xmax);
+
+			unsigned int mask[8];
+			if(accept)
+				std::fill(mask, mask+8, 0xFF);
+			else
+				block_coverage(E, e, inside, fits32, mask);
+
+			unsigned int any = 0;
+			for(int r = 0; r < 8; r++){
+				mask[r] = (rows >> r & 1)? mask[r] & cols: 0;
+				any |= mask[r];
+			}
+			if(any)
+				cover(bx, by, mask);
+		}
+	}
+}
+
+// Idem, consultando block(bx, by) antes de cada bloco 8x8 que toca o
+// triângulo; se retornar false o bloco é descartado (ex.: oclusão).
+template<class Tri, class F, class B>
+void edge_rasterize_triangle(const Tri& P, Scissor S, F span, B block){
+	// trecho em aberto de cada linha da faixa atual, emendado entre blocos vizinhos
+	int band = INT_MIN;
+	int open0[8], open1[8];
+	std::fill(open0, open0 + 8, INT_MIN);
+	std::fill(open1, open1 + 8, INT_MIN);
+	auto flush = [&]{
+		for(int r = 0; r < 8; r++)
+			if(open0[r] != INT_MIN){
+				span(band + r, open0[r], open1[r]);
+				open0[r] = open1[r] = INT_MIN;
+			}
+	};
+
+	edge_rasterize_blocks(P, S, block, [&](int bx, int by, const unsigned int* mask){
+		if(by != band){
+			flush();
+			band = by;
+		}
+		for(int r = 0; r < 8; r++){
+			unsigned int m = mask[r];
+			while(m){
+				int c0 = __builtin_ctz(m);
+				int c1 = c0 + __builtin_ctz(~(m >> c0));
+				m &= ~0u << c1;
+
+				if(open1[r] == bx + c0){
+					open1[r] = bx + c1;
+				}else{
+					if(open0[r] != INT_MIN)
+						span(by + r, open0[r], open1[r]);
+					open0[r] = bx + c0;
+					open1[r] = bx + c1;
+				}
+			}
+		}
+	});
+	flush();
+}
+
+// Percorre o triângulo em quads 2x2 alinhados, chamando quad(x, y, m) para
+// cada quad com algum pixel coberto; o bit dx + 2*dy de m indica o pixel
+// (x + dx, y + dy). Os quads de um bloco 8x8 vêm juntos.
+template<class Tri, class Q, class B>
+void edge_rasterize_quads(const Tri& P, Scissor S, Q quad, B block){
+	edge_rasterize_blocks(P, S, block, [&](int bx, int by, const unsigned int* mask){
+		for(int r = 0; r < 8; r += 2)
+			for(int c = 0; c < 8; c += 2){
+				unsigned int m = (mask[r] >> c & 3) | (mask[r+1] >> c & 3) << 2;
+				if(m)
+					quad(bx + c, by + r, m);
+			}
+	});
+}
+
+template<class Tri, class Q>
+void edge_rasterize_quads(const Tri& P, Scissor S, Q quad){
+	edge_rasterize_quads(P, S, quad, [](int, int){ return true; });
+}
+
+// Cobertura com várias amostras por pixel: chama f(x, y, mask) para cada
+// pixel de S com alguma das n amostras dentro do triângulo. A amostra s fica
+// em (x + offsets[s][0]/16, y + offsets[s][1]/16), com |offset| < 8, e é o
+// bit s de mask. Blocos 8x8 inteiramente dentro não testam as amostras.
+template<class Tri, class F>
+void edge_rasterize_samples(const Tri& P, Scissor S, const int (*offsets)[2], int n, F f){
+	int64_t X[3], Y[3];
+	EdgeFunction E[3];
+	if(!edge_functions(P, X, Y, E))
+		return;
+
+	// pixels cujo centro está a menos de meio pixel do triângulo
+	int xmin = std::max<int64_t>(S.x0, -floor_div(-(std::min({X[0], X[1], X[2]}) - 8), 16));
+	int ymin = std::max<int64_t>(S.y0, -floor_div(-(std::min({Y[0], Y[1], Y[2]}) - 8), 16));
+	int xmax = std::min<int64_t>(S.x1-1, floor_div(std::max({X[0], X[1], X[2]}) + 8, 16));
+	int ymax = std::min<int64_t>(S.y1-1, floor_div(std::max({Y[0], Y[1], Y[2]}) + 8, 16));
+	if(xmin > xmax || ymin > ymax)
+		return;
+
+	// deslocamento de cada aresta em cada amostra e extremos num bloco
+	int64_t off[3][32], dmin[3], dmax[3];
+	for(int k = 0; k < 3; k++){
+		int64_t omin = INT64_MAX, omax = INT64_MIN;
+		for(int i = 0; i < n; i++){
+			off[k][i] = (E[k].A*offsets[i][0] + E[k].B*offsets[i][1])/16;
+			omin = std::min(omin, off[k][i]);
+			omax = std::max(omax, off[k][i]);
+		}
+		dmin[k] = std::min<int64_t>(0, 7*E[k].A) + std::min<int64_t>(0, 7*E[k].B) + omin;
+		dmax[k] = std::max<int64_t>(0, 7*E[k].A) + std::max<int64_t>(0, 7*E[k].B) + omax;
 	}
-	
+
+	unsigned int full = (n == 32)? ~0u: (1u << n) - 1;
+	for(int by = ymin & ~7; by <= ymax; by += 8)
+		for(int bx = xmin & ~7; bx <= xmax; bx += 8){
+			int64_t e[3];
+			bool reject = false;
+			bool accept = true;
+			for(int k = 0; k < 3; k++){
+				e[k] = E[k].at(bx, by);
+				accept = accept && e[k] + dmin[k] >= 0;
+				reject = reject || e[k] + dmax[k] < 0;
+			}
+			if(reject)
+				continue;
+
+			int x0 = std::max(bx, xmin), x1 = std::min(bx + 7, xmax);
+			int y0 = std::max(by, ymin), y1 = std::min(by + 7, ymax);
+			for(int y = y0; y <= y1; y++)
+				for(int x = x0; x <= x1; x++){
+					if(accept){
+						f(x, y, full);
+						continue;
+					}
+					int64_t c[3] = { E[0].at(x, y), E[1].at(x, y), E[2].at(x, y) };
+					unsigned int mask = 0;
+					for(int i = 0; i < n; i++)
+						if(c[0] + off[0][i] >= 0 && c[1] + off[1][i] >= 0 && c[2] + off[2][i] >= 0)
+							mask |= 1u << i;
+					if(mask)
+						f(x, y, mask);
+				}
+		}
+}
+
+template<class Tri>
+std::vector<Pixel> edge_rasterize_triangle(const Tri& P, Scissor S = no_scissor){
+	std::vector<Pixel> out;
+	edge_rasterize_triangle(P, S, [&](int y, int x0, int x1){
+		for(int x = x0; x < x1; x++)
+			out.push_back({x, y});
+	});
 	return out;
 }
 
@@ -2,6 +2,7 @@
 #include "raytracing.h"
 #include "transforms.h"
 #include "Phong.h"
+#include "AreaLight.h"
 #include <random>
 
 //#define USE_BOUNDING_SPHERE
@@ -14,11 +15,7 @@ static float random_value(float a, float b){
     std::uniform_real_distribution<float> distribution(a, b);
     return distribution(generator);
 }
-            
-vec3 get_random_position(vec3 position, float r){
-    vec3 p = {random_value(-r, r), random_value(-r, r), random_value(-r, r)};
-    return position + p;
-}
+
 
 void show_progress(int current_value, int max_value){
     float percent = (float)current_value/(float)max_value*100;
@@ -30,8 +27,12 @@ struct Scene{
     Camera camera;
     Light light;
     std::vector<RTMesh> meshes;
+    AreaLight area_light;
 
     void render(){
+        // a luz de área fica centrada na luz pontual
+        area_light.center = toVec3(light.position);
+
         #pragma omp parallel for schedule(dynamic, 1)  // OpenMP
         for(int y = 0; y < image.height(); y++){
             show_progress(y, image.height()-1);
@@ -47,16 +48,16 @@ struct Scene{
 
         sample_textures(I.material, I.texCoords);
 
-        float shadow = 0;
-        int ns = 50;
-        for(int i = 0; i < ns; i++){
-            vec3 lpos = get_random_position(toVec3(light.position), 0.5);
-            Ray light_ray{I.position, normalize(lpos - I.position)};
-            MatTriIntersection Ilight = min_intersection(light_ray, meshes);
-            if(Ilight.t == HUGE_VALF)
-                shadow++;
-        }
-        shadow /= ns;
+        // até 7x7 raios de sombra; 8 bastam fora da penumbra
+        float shadow = light_visibility(area_light, I.position, 7, 8,
+            [&](vec3 p, vec3 q){
+                // direção unitária: o epsilon de auto-interseção não depende da distância
+                float dist = norm(q - p);
+                MatTriIntersection Ilight = min_intersection(Ray{p, (1/dist)*(q - p)}, meshes);
+                return Ilight.t < dist;
+            },
+            [](){ return random_value(0, 1); }
+        );
         
         I.material.Kd = shadow*I.material.Kd;
         I.material.Ks = shadow*I.material.Ks;
@@ -99,7 +100,12 @@ int main(){
 	        vec3{1.0, 1.0, 1.0}, // Id
 	        vec3{1.0, 1.0, 1.0}  // Is
         },
-        get_meshes()
+        get_meshes(),
+        AreaLight{
+            vec3{0, 0, 0},     // center: a posição de light (ver render)
+            vec3{1.0, 0, 0},   // u
+            vec3{0, 0, 1.0}    // v
+        }
     };
 	scene.camera.lookAt({10, 7, 20}, {0, 4, 0}, {0, 1, 0});
     scene.render();
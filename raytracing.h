@@ -261,6 +261,10 @@ class BoundingBox{
         return 0.5*(pmin + pmax);
     }
 
+    vec3 min() const{ return pmin; }
+    vec3 max() const{ return pmax; }
+    bool empty() const{ return !init; }
+
     void add(vec3 p){
         if(!init){
             pmin = pmax = p;
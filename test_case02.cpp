@@ -1,8 +1,11 @@
 #include "acutest.h"
 #include "rasterization.h"
 #include "Primitives.h"
+#include "Render2D.h"
 #include <iostream>
 #include <chrono>
+#include <set>
+#include <map>
 
 bool operator==(Pixel a, Pixel b) {
     return a.x == b.x && a.y == b.y;
@@ -108,6 +111,79 @@ void test_degenerated(){
     }
 }
 
+// Distância de p à reta mais próxima entre as arestas de T
+float edge_distance(Pixel p, const Triangle<vec2>& T){
+    float d = HUGE_VALF;
+    for(int i = 0; i < 3; i++){
+        vec2 A = T[i], B = T[(i+1)%3];
+        vec2 n = {B[1] - A[1], A[0] - B[0]};
+        d = std::min(d, (float)fabs(dot(toVec2(p) - A, n))/norm(n));
+    }
+    return d;
+}
+
+void test_edge_function(){
+    std::vector<Triangle<vec2>> Triangles = {
+        {vec2{7.92, 9.54}, vec2{3.36, 6.32}, vec2{7.62, 4.92}},
+        {vec2{-9.03, -5.04}, vec2{0.96, 3.42}, vec2{10.61, -9.52}},
+        {vec2{117.53, 30.46}, vec2{20.3, 30.46}, vec2{73.3, 70.5}},
+        {vec2{100, 500}, vec2{100, 100}, vec2{400, 300}},
+        {vec2{400.84, 100.24}, vec2{900.78, 400.21}, vec2{600.32, 300.98}},
+        {vec2{-40.5, 13.2}, vec2{300.7, -20.1}, vec2{150.2, 260.9}},
+    };
+
+    for(auto T: Triangles){
+        std::vector<Pixel> A = simple_rasterize_triangle(T);
+        std::vector<Pixel> B = edge_rasterize_triangle(T);
+
+        // só podem diferir nos pixels sobre as arestas
+        std::set<std::pair<int,int>> SA, SB;
+        for(Pixel p: A) SA.insert({p.x, p.y});
+        for(Pixel p: B) SB.insert({p.x, p.y});
+        TEST_CHECK(SB.size() == B.size());
+
+        for(Pixel p: A)
+            if(!SB.count({p.x, p.y}))
+                TEST_CHECK(edge_distance(p, T) < 0.1);
+        for(Pixel p: B)
+            if(!SA.count({p.x, p.y}))
+                TEST_CHECK(edge_distance(p, T) < 0.1);
+
+        // o recorte não muda os pixels dentro da janela
+        Scissor S{10, 20, 137, 150};
+        int n = 0;
+        for(Pixel p: B)
+            n += p.x >= S.x0 && p.x < S.x1 && p.y >= S.y0 && p.y < S.y1;
+        TEST_CHECK(edge_rasterize_triangle(T, S).size() == (size_t)n);
+    }
+}
+
+void test_shared_edges(){
+    // leque de triângulos com arestas passando por centros de pixels
+    vec2 c = {50, 50};
+    std::vector<vec2> border = {
+        {10, 10}, {50, 10}, {90, 10}, {90, 50}, 
+        {90, 90}, {50, 90}, {10, 90}, {10, 50},
+    };
+
+    int count[100][100] = {};
+    for(unsigned int i = 0; i < border.size(); i++){
+        Triangle<vec2> T = {c, border[i], border[(i+1)%border.size()]};
+        if(i%2)
+            std::swap(T[1], T[2]);
+
+        for(Pixel p: edge_rasterize_triangle(T))
+            count[p.y][p.x]++;
+    }
+
+    bool ok = true;
+    for(int y = 0; y < 100; y++)
+        for(int x = 0; x < 100; x++){
+            bool interior = x > 10 && x < 90 && y > 10 && y < 90;
+            ok = ok && count[y][x] <= 1 && (!interior || count[y][x] == 1);
+        }
+    TEST_CHECK(ok);
+}
 
 void test_performance(){
     Triangle<vec2> T = {
@@ -129,12 +205,108 @@ void test_performance(){
     TEST_CHECK((p1 - p0) > 20*(p2 - p1));
 }
 
+void test_lines(){
+    std::vector<Line<vec2>> Lines = {
+        {vec2{2, 3}, vec2{17, 9}},
+        {vec2{17, 9}, vec2{2, 3}},
+        {vec2{4, 1}, vec2{7, 20}},
+        {vec2{-5.3, 2.6}, vec2{30.2, -7.7}},
+        {vec2{3.4, 3.4}, vec2{3.4, 3.4}},
+    };
+    Scissor S = {0, 0, 20, 15};
+
+    for(auto L: Lines){
+        // um pixel por passo do eixo principal, vizinhos conectados, t crescente de A para B
+        std::vector<Pixel> P;
+        std::vector<float> t;
+        rasterizeLineSpan(L[0], L[1], no_scissor, [&](Pixel p, float ti){
+            P.push_back(p);
+            t.push_back(ti);
+        });
+        vec2 d = L[1] - L[0];
+        int n = (int)round(std::max(fabs(d[0]), fabs(d[1]))) + 1;
+        TEST_CHECK(abs((int)P.size() - n) <= 1);
+        TEST_MSG("%d pixels, esperado %d", (int)P.size(), n);
+        for(unsigned int i = 1; i < P.size(); i++)
+            TEST_CHECK(abs(P[i].x - P[i-1].x) <= 1 && abs(P[i].y - P[i-1].y) <= 1);
+
+        bool from_A = toPixel(L[0]) == P.front() || toPixel(L[0]) == P.back();
+        TEST_CHECK(from_A);
+        float t0 = toPixel(L[0]) == P.front()? t.front(): t.back();
+        TEST_CHECK(t0 < 0.2f);
+
+        // o scissor só remove pixels
+        std::set<std::pair<int,int>> all;
+        for(Pixel p: P)
+            all.insert({p.x, p.y});
+        rasterizeLineSpan(L[0], L[1], S, [&](Pixel p, float){
+            TEST_CHECK(p.x >= S.x0 && p.x < S.x1 && p.y >= S.y0 && p.y < S.y1);
+            TEST_CHECK(all.count({p.x, p.y}) == 1);
+        });
+
+        // anti-serrilhado: cobertura total de cada passo interno igual a 1
+        std::map<int, float> cover;
+        rasterizeLineAA(L[0], L[1], no_scissor, [&](Pixel p, float, float c){
+            TEST_CHECK(c >= 0 && c <= 1);
+            bool steep = fabs(d[1]) > fabs(d[0]);
+            cover[steep? p.y: p.x] += c;
+        });
+        for(auto [i, c]: cover){
+            if(i == cover.begin()->first || i == cover.rbegin()->first)
+                continue;
+            TEST_CHECK(fabs(c - 1) < 1e-3);
+        }
+    }
+}
+
+void test_fill_2d(){
+    std::vector<Triangle<Vec2Col>> Tris = {
+        {Vec2Col{{3.2, 4.7}, red}, Vec2Col{{50.6, 12.1}, green}, Vec2Col{{20.3, 38.9}, blue}},
+        {Vec2Col{{-20, -10}, white}, Vec2Col{{70, 5}, black}, Vec2Col{{10, 60}, yellow}},
+        {Vec2Col{{5, 5}, red}, Vec2Col{{30, 30}, blue}, Vec2Col{{55, 55}, green}},
+    };
+
+    for(auto T: Tris){
+        ImageRGB G{40, 30};
+        G.fill(gray);
+        Render2dPipeline{G}.draw(T);
+
+        // mesmos pixels do scanline, com a cor interpolada pelas coordenadas baricêntricas
+        Triangle<vec2> P = {T[0].position, T[1].position, T[2].position};
+        std::set<std::pair<int,int>> inside;
+        for(Pixel p: scanline(P, Scissor{0, 0, G.width(), G.height()}))
+            inside.insert({p.x, p.y});
+
+        int bad = 0;
+        for(int y = 0; y < G.height(); y++)
+            for(int x = 0; x < G.width(); x++){
+                if(!inside.count({x, y})){
+                    bad += G(x, y) != gray;
+                    continue;
+                }
+                if(isDegenerated(P))
+                    continue;
+                vec3 b = barycentric_coords(vec2{(float)x, (float)y}, P);
+                vec3 c = b[0]*toVec(T[0].color) + b[1]*toVec(T[1].color) + b[2]*toVec(T[2].color);
+                RGB e = toColor(c);
+                for(int k = 0; k < 3; k++)
+                    bad += abs(G(x, y)[k] - e[k]) > 1;
+            }
+        TEST_CHECK(bad == 0);
+        TEST_MSG("bad = %d", bad);
+    }
+}
+
 TEST_LIST = {
     {"casos gerais", test_general},
     {"arestas horizontais", test_horizontal_edges},
     {"arestas verticais", test_vertical_edges},
     {"triangulos finos", test_slim},
     {"triangulos degenerados", test_degenerated},
+    {"funcoes de aresta", test_edge_function},
+    {"arestas compartilhadas", test_shared_edges},
     {"performance", test_performance},
+    {"linhas", test_lines},
+    {"preenchimento 2D", test_fill_2d},
     {NULL, NULL}
 };
\ No newline at end of file
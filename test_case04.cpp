@@ -5,6 +5,7 @@
 #include "VertexUtils.h"
 #include "Color.h"
 #include <iostream>
+#include <set>
 
 bool close_points(vec2 u, vec2 v){
     return norm2(u - v) < 1e-5;
@@ -63,7 +64,42 @@ void test_clip_line(){
     }
 }
 
+void test_clip_triangles(){
+    ClipRectangle R = {8.67, 4.92, 22.31, 12.59};
+    std::vector<Triangle<Vec2Col>> tris = {
+        { Vec2Col{{10, 6}, red},   Vec2Col{{20, 7}, green},   Vec2Col{{15, 11}, blue}   },  // dentro
+        { Vec2Col{{0, 0}, red},    Vec2Col{{5, 1}, green},    Vec2Col{{2, 4}, blue}     },  // fora
+        { Vec2Col{{6, 10}, red},   Vec2Col{{25.5, 15.9}, green}, Vec2Col{{17.9, 2.5}, blue} },
+        { Vec2Col{{0, -5}, red},   Vec2Col{{40, 8}, yellow},  Vec2Col{{5, 30}, cyan}    },  // cobre o retângulo
+    };
+
+    // mesmo resultado do recorte de polígonos com vetores
+    std::vector<Triangle<Vec2Col>> expected;
+    for(auto tri: tris){
+        std::vector<Vec2Col> polygon = clip(std::vector<Vec2Col>{tri[0], tri[1], tri[2]}, R);
+        for(unsigned int i = 1; i+1 < polygon.size(); i++)
+            expected.push_back({polygon[0], polygon[i], polygon[i+1]});
+    }
+
+    auto clipped = clip(tris, R);
+    TEST_ASSERT(clipped.size() == expected.size());
+    TEST_MSG("%d triangulos, esperado %d", (int)clipped.size(), (int)expected.size());
+
+    // o ponto de partida do leque pode mudar: compara os conjuntos de vértices
+    auto key = [](Vec2Col v){ return std::make_pair(roundf(v.position[0]*1000), roundf(v.position[1]*1000)); };
+    std::set<std::pair<float,float>> A, B;
+    for(unsigned int i = 0; i < clipped.size(); i++)
+        for(int k = 0; k < 3; k++){
+            A.insert(key(clipped[i][k]));
+            B.insert(key(expected[i][k]));
+            vec2 p = clipped[i][k].position;
+            TEST_CHECK(p[0] >= R.x0 - 1e-4 && p[0] <= R.x1 + 1e-4 && p[1] >= R.y0 - 1e-4 && p[1] <= R.y1 + 1e-4);
+        }
+    TEST_CHECK(A == B);
+}
+
 TEST_LIST = {
     {"clip line", test_clip_line},
+    {"clip triangles", test_clip_triangles},
     {NULL, NULL}
 };
\ No newline at end of file
@@ -161,11 +161,66 @@ void test_clip_triangle_tex_normal(){
     TEST_CHECK(clipped == expected);
 }
 
+template<class Vertex>
+std::vector<Vertex> clip_fixed(const std::vector<Vertex>& P){
+    ClipPolygon<Vertex> R;
+    clip(Triangle<Vertex>{P[0], P[1], P[2]}, R);
+    return std::vector<Vertex>(R.v, R.v + R.n);
+}
+
+void test_clip_triangle_fixed(){
+    std::vector< std::vector<vec3> > triangles = {
+        {{0.1, 0.2, 0.2}, {-0.2, -0.27, 0.37}, {-0.7, -0.3, 0.3} },
+        {{10, 0, 0}, {0, 10, 0}, {0, 0, 10} },
+        {{2, 0.1, -0.7}, {3, -0.7, -0.4}, {1.2, 0.4, 1} },
+        {{1.3, 0, 0}, {0, 1.78, 0}, {0, 0, 1.27} },
+        {{1.19, 0.2, 0.1}, {-0.2, 0.14, 1.33}, {0.1, 1.23, 0.2} },
+        {{-3, -2.5, 0.3}, {2.7, -1.2, -1.6}, {0.4, 3.1, 2.2} },
+    };
+
+    for(auto P: triangles){
+        auto clipped = clip(P);
+        auto fixed = clip_fixed(P);
+        TEST_CHECK(fixed == clipped);
+        TEST_CHECK(fixed.size() <= 9);
+    }
+
+    std::vector<Vertex> P = {
+        {{1.19, 0.2, 0.1}, {0, 0, 0}},
+        {{-0.2, 0.14, 1.33}, {.3, .5, 1}},
+        {{0.1, 1.23, 0.2}, {.7, .9, .7}},
+    };
+    TEST_CHECK(clip_fixed(P) == clip(P));
+}
+
+void test_guard_band(){
+    // só sai da tela em x e y: nada a recortar na banda de guarda
+    std::vector<vec3> P = { {-3, -2, 0.5}, {4, -1, 0.2}, {0, 5, -0.3} };
+    ClipPolygon<vec3> R;
+    unsigned int g = 0;
+    for(vec3 v: P)
+        g |= outcode(toVec4(v), guard_band_normals());
+    TEST_CHECK(g == 0);
+
+    // atravessa o plano z = -w: só ele é recortado
+    std::vector<vec3> Q = { {-3, -2, -1.5}, {4, -1, 0.2}, {0, 5, -0.3} };
+    g = 0;
+    for(vec3 v: Q)
+        g |= outcode(toVec4(v), guard_band_normals());
+    TEST_CHECK(g == 2);
+    TEST_CHECK(clip(Triangle<vec3>{Q[0], Q[1], Q[2]}, R, g, guard_band_normals()));
+    TEST_CHECK(R.n == 4);
+    for(int i = 0; i < R.n; i++)
+        TEST_CHECK(R.v[i][2] >= -1 - 1e-5);
+}
+
 TEST_LIST = {
     {"clip triangle - vec3 - inside", test_clip_triangle_inside},
     {"clip triangle - vec3 - outside", test_clip_triangle_outside},
     {"clip triangle - vec3", test_clip_triangle},
     {"clip triangle - position color", test_clip_triangle_color},
     {"clip triangle - pos texcoords normal", test_clip_triangle_tex_normal},
+    {"clip triangle - fixed capacity", test_clip_triangle_fixed},
+    {"guard band", test_guard_band},
     {NULL, NULL}
 };
\ No newline at end of file
@@ -0,0 +1,420 @@
+#include "acutest.h"
+#include "Render3D.h"
+#include "ZBuffer.h"
+#include "ColorShader.h"
+#include "TextureShader.h"
+#include "ShadowMap.h"
+#include "TileCache.h"
+#include "transforms.h"
+
+// Cena com triângulos sobrepostos, alguns cruzando a borda da tela e o plano near
+std::vector<Vec3Col> scene_vertices(int n){
+    std::vector<Vec3Col> V;
+    unsigned int seed = 12345;
+    auto rnd = [&](float a, float b){
+        seed = seed*1103515245u + 12345u;
+        return a + (b - a)*((seed >> 8) & 0xFFFF)/65535.0f;
+    };
+
+    for(int i = 0; i < 3*n; i++){
+        vec3 pos = {rnd(-6, 6), rnd(-5, 5), rnd(-12, 2)};
+        RGB color = {(Byte)rnd(0, 255), (Byte)rnd(0, 255), (Byte)rnd(0, 255)};
+        V.push_back({pos, color});
+    }
+    return V;
+}
+
+bool same_image(const ImageRGB& A, const ImageRGB& B){
+    for(int y = 0; y < A.height(); y++)
+        for(int x = 0; x < A.width(); x++)
+            if(A(x, y) != B(x, y))
+                return false;
+    return true;
+}
+
+void test_binned_equals_serial(){
+    int w = 301, h = 203;
+    std::vector<Vec3Col> V = scene_vertices(200);
+    Triangles T{V.size()};
+
+    ColorShader shader;
+    shader.M = perspective(50, w/(float)h, 0.5, 50)*lookAt({0, 0, 5}, {0, 0, 0}, {0, 1, 0});
+
+    for(int tile_size: {64, 16, 24}){
+        ImageRGB A{w, h}, B{w, h};
+        A.fill(white);
+        B.fill(white);
+
+        ImageZBuffer ZA{A}, ZB{B};
+        render(V, T, shader, ZA);
+
+        RenderPipeline<ColorShader, ImageZBuffer> pipeline{shader, ZB};
+        pipeline.run_binned(V, T, tile_size);
+
+        TEST_CHECK(same_image(A, B));
+        TEST_MSG("tile_size = %d", tile_size);
+    }
+}
+
+int count_painted(const ImageRGB& img){
+    int n = 0;
+    for(int y = 0; y < img.height(); y++)
+        for(int x = 0; x < img.width(); x++)
+            n += img(x, y) != white;
+    return n;
+}
+
+void test_cull(){
+    // mesmo triângulo nas duas orientações, parte dele fora da tela
+    std::vector<Vec3Col> ccw = { {{-0.5, -0.5, 0}, red}, {{1.5, -0.5, 0}, red}, {{0, 0.5, 0}, red} };
+    std::vector<Vec3Col> cw  = { ccw[0], ccw[2], ccw[1] };
+    Triangles T{3};
+
+    ColorShader shader;
+    shader.M = loadIdentity();
+
+    struct Case{ CullMode cull; FrontFace front; bool ccw_visible, cw_visible; };
+    for(Case c: {
+        Case{CULL_NONE,  FRONT_CCW, true,  true},
+        Case{CULL_BACK,  FRONT_CCW, true,  false},
+        Case{CULL_FRONT, FRONT_CCW, false, true},
+        Case{CULL_BACK,  FRONT_CW,  false, true},
+    }){
+        ImageRGB A{64, 64}, B{64, 64};
+        A.fill(white);
+        B.fill(white);
+
+        RenderPipeline<ColorShader, ImageRGB> PA{shader, A, c.cull, c.front};
+        PA.run(ccw, T);
+        RenderPipeline<ColorShader, ImageRGB> PB{shader, B, c.cull, c.front};
+        PB.run(cw, T);
+
+        TEST_CHECK((count_painted(A) > 0) == c.ccw_visible);
+        TEST_CHECK((count_painted(B) > 0) == c.cw_visible);
+        TEST_CHECK(!c.ccw_visible || !c.cw_visible || same_image(A, B));
+    }
+
+    // área nula não gera pixels
+    std::vector<Vec3Col> flat = { {{-0.5, -0.5, 0}, red}, {{0.5, 0.5, 0}, red}, {{0, 0, 0}, red} };
+    ImageRGB C{64, 64};
+    C.fill(white);
+    render(flat, T, shader, C);
+    TEST_CHECK(count_painted(C) == 0);
+}
+
+void test_deferred(){
+    int w = 301, h = 203;
+    std::vector<Vec3Col> V = scene_vertices(200);
+    Triangles T{V.size()};
+
+    ColorShader shader;
+    shader.M = perspective(50, w/(float)h, 0.5, 50)*lookAt({0, 0, 5}, {0, 0, 0}, {0, 1, 0});
+
+    ImageRGB A{w, h}, B{w, h};
+    A.fill(white);
+    B.fill(white);
+
+    ImageZBuffer ZA{A}, ZB{B};
+    render(V, T, shader, ZA);
+    render_deferred(V, T, shader, ZB);
+
+    // mesmos triângulos visíveis; as cores só diferem no arredondamento
+    int maxdiff = 0;
+    for(int y = 0; y < h; y++)
+        for(int x = 0; x < w; x++)
+            for(int c = 0; c < 3; c++)
+                maxdiff = std::max(maxdiff, abs(A(x, y)[c] - B(x, y)[c]));
+    TEST_CHECK(maxdiff <= 1);
+    TEST_MSG("maxdiff = %d", maxdiff);
+}
+
+void test_policies(){
+    // dois triângulos iguais, o segundo mais longe
+    std::vector<Vec3Col> V = {
+        {{-0.5, -0.5, 0.0}, {100, 0, 0}}, {{0.5, -0.5, 0.0}, {100, 0, 0}}, {{0, 0.5, 0.0}, {100, 0, 0}},
+        {{-0.5, -0.5, 0.5}, {0, 100, 0}}, {{0.5, -0.5, 0.5}, {0, 100, 0}}, {{0, 0.5, 0.5}, {0, 100, 0}},
+    };
+    Triangles T{V.size()};
+
+    ColorShader shader;
+    shader.M = loadIdentity();
+
+    ImageRGB A{64, 64}, B{64, 64}, C{64, 64}, D{64, 64};
+    A.fill(black);
+    B.fill(black);
+    C.fill(black);
+    D.fill(black);
+
+    ImageZBuffer ZA{A}, ZB{B}, ZC{C};
+    render(V, T, shader, ZA);
+    render<PipelinePolicy<false>>(V, T, shader, ZB);
+    render<PipelinePolicy<true, true, CLIP_GUARD_BAND, BLEND_ADD>>(V, T, shader, ZC);
+    render<PipelinePolicy<false, false, CLIP_NONE, BLEND_ADD, CULL_BACK>>(V, T, shader, D);
+
+    RGB a = A(32, 32), b = B(32, 32), c = C(32, 32), d = D(32, 32);
+    TEST_CHECK(a == (RGB{100, 0, 0}));  // o mais perto
+    TEST_CHECK(b == (RGB{0, 100, 0}));  // o último desenhado
+    TEST_CHECK(c == (RGB{100, 0, 0}));  // o de trás não passa no teste
+    TEST_CHECK(d == (RGB{100, 100, 0}));
+
+    // com w = 1 a correção perspectiva não muda nada
+    ImageRGB E{64, 64};
+    E.fill(black);
+    ImageZBuffer ZE{E};
+    render<PipelinePolicy<true, false>>(V, T, shader, ZE);
+    TEST_CHECK(same_image(A, E));
+
+    // cull fixo em tempo de compilação == cull escolhido em tempo de execução
+    std::vector<Vec3Col> cw = { V[0], V[2], V[1] };
+    ImageRGB F{64, 64}, G{64, 64};
+    F.fill(white);
+    G.fill(white);
+    RenderPipeline<ColorShader, ImageRGB> PF{shader, F, CULL_BACK};
+    PF.run(cw, Triangles{3});
+    render<PipelinePolicy<true, true, CLIP_GUARD_BAND, BLEND_REPLACE, CULL_BACK>>(cw, Triangles{3}, shader, G);
+    TEST_CHECK(count_painted(F) == 0 && same_image(F, G));
+}
+
+// Varying com um membro que não pode ser interpolado como float
+struct TaggedVarying{
+    vec4 position;
+    int tag;
+};
+TaggedVarying operator*(float t, TaggedVarying v){ return {t*v.position, v.tag}; }
+TaggedVarying operator+(TaggedVarying u, TaggedVarying v){ return {u.position + v.position, u.tag}; }
+
+template<>
+struct is_flat_varying<TaggedVarying> : std::false_type{};
+
+void test_flat_varying(){
+    using V = ColorShader::Varying;
+    static_assert(is_flat_varying_v<V>);
+    static_assert(flat_size<V> == 7);
+    static_assert(!is_flat_varying_v<TaggedVarying>);
+
+    V a = {{1, 2, 3, 4}, {0.1, 0.2, 0.3}};
+    V b = {{-1, 0, 5, 1}, {0.5, 0.5, 0.5}};
+    V c = {{2, 2, 2, 2}, {1, 0, 1}};
+
+    V r = varying_combine(0.2f, a, 0.3f, b, 0.5f, c);
+    V s = 0.2f*a + 0.3f*b + 0.5f*c;
+    TEST_CHECK(norm(r.position - s.position) < 1e-5 && norm(r.color - s.color) < 1e-5);
+
+    V l = varying_lerp(0.25f, a, b);
+    TEST_CHECK(norm(l.position - (0.75f*a.position + 0.25f*b.position)) < 1e-5);
+
+    // sem o trait, os operadores do tipo são usados e tag não é misturado
+    TaggedVarying t = varying_lerp(0.5f, TaggedVarying{{0, 0, 0, 1}, 7}, TaggedVarying{{2, 2, 2, 1}, 9});
+    TEST_CHECK(t.tag == 7 && t.position[0] == 1);
+}
+
+struct TexVertex{
+    vec3 position;
+    vec2 texCoords;
+};
+
+// Mesmo shader, sem a versão para quads
+struct ScalarTextureShader{
+    using Varying = TextureShader::Varying;
+    TextureShader& S;
+
+    template<class Vertex>
+    void vertexShader(Vertex in, Varying& out){ S.vertexShader(in, out); }
+    void fragmentShader(Varying V, RGB& FragColor){ S.fragmentShader(V, FragColor); }
+};
+
+void test_quads_mipmaps(){
+    static_assert(has_quad_shader<TextureShader>::value);
+    static_assert(!has_quad_shader<ScalarTextureShader>::value);
+
+    // xadrez de 1 texel, repetido 8 vezes na tela: cada pixel cobre 8x8 texels
+    TextureShader shader;
+    shader.M = loadIdentity();
+    shader.texture.filter = BILINEAR;
+    shader.texture.wrapX = REPEAT;
+    shader.texture.wrapY = REPEAT;
+    shader.texture.img = ImageRGB{64, 64};
+    for(int y = 0; y < 64; y++)
+        for(int x = 0; x < 64; x++)
+            shader.texture.img(x, y) = (x + y)%2? white: black;
+
+    std::vector<TexVertex> V = {
+        {{-1, -1, 0}, {0, 0}}, {{1, -1, 0}, {8, 0}}, {{1, 1, 0}, {8, 8}},
+        {{-1, -1, 0}, {0, 0}}, {{1, 1, 0}, {8, 8}}, {{-1, 1, 0}, {0, 8}},
+    };
+    Triangles T{V.size()};
+
+    // sem mipmaps, quads e pixels isolados dão o mesmo resultado
+    ImageRGB A{64, 64}, B{64, 64};
+    ScalarTextureShader scalar{shader};
+    render(V, T, shader, A);
+    render(V, T, scalar, B);
+    TEST_CHECK(same_image(A, B));
+
+    shader.texture.generateMipmaps();
+    TEST_CHECK(shader.texture.mipmaps.size() == 6);
+    TEST_CHECK(shader.texture.mipmaps.back().width() == 1);
+
+    // com mipmaps, o xadrez vira cinza
+    ImageRGB C{64, 64};
+    render(V, T, shader, C);
+    int maxdiff = 0;
+    for(int y = 0; y < 64; y++)
+        for(int x = 0; x < 64; x++)
+            maxdiff = std::max(maxdiff, abs(C(x, y)[0] - 128));
+    TEST_CHECK(maxdiff <= 2);
+    TEST_MSG("maxdiff = %d", maxdiff);
+}
+
+void test_msaa(){
+    ColorShader shader;
+    shader.M = loadIdentity();
+
+    std::vector<Vec3Col> tri = { {{-0.8, -0.7, 0}, red}, {{0.9, -0.2, 0}, red}, {{-0.1, 0.85, 0}, red} };
+    Triangles T{3};
+
+    // uma amostra no centro: igual ao desenho sem MSAA
+    ImageRGB A{64, 64}, B{64, 64};
+    A.fill(white);
+    B.fill(white);
+    ImageZBuffer ZA{A};
+    render(tri, T, shader, ZA);
+    ImageZBufferMSAA MB{B, 1};
+    render(tri, T, shader, MB);
+    MB.resolve();
+    TEST_CHECK(same_image(A, B));
+
+    // 4 amostras: a cobertura média dá a área do triângulo
+    for(int n: {4, 8}){
+        ImageRGB C{64, 64};
+        C.fill(white);
+        ImageZBufferMSAA MC{C, n};
+        render(tri, T, shader, MC);
+        MC.resolve();
+
+        float coverage = 0;
+        int partial = 0;
+        for(int y = 0; y < 64; y++)
+            for(int x = 0; x < 64; x++){
+                int g = C(x, y)[1];
+                coverage += (255 - g)/255.0f;
+                partial += g != 0 && g != 255;
+            }
+        // vértices na tela: (x+1)*32 - 0.5
+        vec2 P[] = { {5.9, 9.1}, {60.3, 25.1}, {28.3, 58.7} };
+        vec2 u = P[1] - P[0], v = P[2] - P[0];
+        float area = fabs(u[0]*v[1] - u[1]*v[0])/2;
+        TEST_CHECK(partial > 0);
+        TEST_CHECK(fabs(coverage - area) < 0.01*area);
+        TEST_MSG("n = %d, coverage = %f, area = %f", n, coverage, area);
+    }
+
+    // dois triângulos com uma aresta em comum: sem emenda visível
+    std::vector<Vec3Col> quad = {
+        {{-0.7, -0.7, 0}, red}, {{0.6, -0.65, 0}, red}, {{0.7, 0.7, 0}, red},
+        {{-0.7, -0.7, 0}, red}, {{0.7, 0.7, 0}, red}, {{-0.6, 0.65, 0}, red},
+    };
+    ImageRGB D{64, 64};
+    D.fill(white);
+    ImageZBufferMSAA MD{D, 4};
+    render(quad, Triangles{6}, shader, MD);
+    MD.resolve();
+    bool seam = false;
+    for(int i = 16; i < 48; i++)
+        seam = seam || D(i, i) != red;
+    TEST_CHECK(!seam);
+}
+
+void test_depth_only(){
+    int w = 301, h = 203;
+    std::vector<Vec3Col> V = scene_vertices(200);
+    Triangles T{V.size()};
+    mat4 M = perspective(50, w/(float)h, 0.5, 50)*lookAt({0, 0, 5}, {0, 0, 0}, {0, 1, 0});
+
+    // mesma profundidade do pipeline completo
+    ColorShader shader;
+    shader.M = M;
+    ImageRGB A{w, h};
+    ImageZBuffer ZA{A};
+    render(V, T, shader, ZA);
+
+    Image<float> depth{w, h};
+    depth.fill(1.0f);
+    render_depth(V, T, M, depth);
+
+    int bad = 0;
+    for(int y = 0; y < h; y++)
+        for(int x = 0; x < w; x++)
+            bad += fabs(depth(x, y) - ZA.depth(x, y)) > 1e-5;
+    TEST_CHECK(bad == 0);
+    TEST_MSG("bad = %d", bad);
+
+    // quadrado em y = 1 sobre o plano y = 0, luz de cima
+    std::vector<vec3> occluder = { {-1, 1, -1}, {1, 1, -1}, {1, 1, 1}, {-1, 1, -1}, {1, 1, 1}, {-1, 1, 1} };
+    ShadowMap shadow{64, 64};
+    shadow.LightSpace = orthogonal(-4, 4, -4, 4, 1, 10)*lookAt({0, 5, 0}, {0, 0, 0}, {0, 0, -1});
+    shadow.render(occluder, Triangles{6}, loadIdentity());
+
+    auto vis = [&](vec3 p){ return shadow.visibility(shadow.LightSpace*toVec4(p)); };
+    TEST_CHECK(vis({0, 0, 0}) == 0);
+    TEST_CHECK(vis({3, 0, 0}) == 1);
+    TEST_CHECK(vis({0, 1.5, 0}) == 1);   // acima do oclusor
+    float edge = vis({1, 0, 0});
+    TEST_CHECK(edge > 0 && edge < 1);    // PCF suaviza a borda
+}
+
+void test_tile_cache(){
+    int w = 301, h = 203;
+    std::vector<Vec3Col> V = scene_vertices(100);
+    std::vector<Vec3Col> box = {
+        {{-0.5, -0.5, 1}, red}, {{0.5, -0.5, 1}, red}, {{0.5, 0.5, 1}, red},
+        {{-0.5, -0.5, 1}, red}, {{0.5, 0.5, 1}, red}, {{-0.5, 0.5, 1}, red},
+    };
+    mat4 VP = perspective(50, w/(float)h, 0.5, 50)*lookAt({0, 0, 5}, {0, 0, 0}, {0, 1, 0});
+
+    ImageRGB A{w, h};
+    TileCache tiles{A, white, 32};
+
+    for(int k = 0; k < 4; k++){
+        // a caixa anda nos quadros 1 e 2 e fica parada no 3
+        mat4 Box = translate(std::min(k, 2)*0.3f, 0, 0);
+
+        ColorShader shader;
+        shader.M = VP;
+        tiles.draw(V, Triangles{V.size()}, shader);
+        shader.M = VP*Box;
+        tiles.draw(box, Triangles{box.size()}, shader);
+        int redrawn = tiles.finish();
+
+        ImageRGB B{w, h};
+        B.fill(white);
+        ImageZBuffer ZB{B};
+        shader.M = VP;
+        render(V, Triangles{V.size()}, shader, ZB);
+        shader.M = VP*Box;
+        render(box, Triangles{box.size()}, shader, ZB);
+
+        TEST_CHECK(same_image(A, B));
+        TEST_MSG("frame %d", k);
+        if(k == 0)
+            TEST_CHECK(redrawn == tiles.tiles());
+        else if(k < 3)
+            TEST_CHECK(redrawn > 0 && redrawn < tiles.tiles()/2);
+        else
+            TEST_CHECK(redrawn == 0);
+        TEST_MSG("frame %d: %d of %d tiles", k, redrawn, tiles.tiles());
+    }
+}
+
+TEST_LIST = {
+    {"binned == serial", test_binned_equals_serial},
+    {"cull", test_cull},
+    {"deferred", test_deferred},
+    {"policies", test_policies},
+    {"flat varying", test_flat_varying},
+    {"quads and mipmaps", test_quads_mipmaps},
+    {"msaa", test_msaa},
+    {"depth only and shadow map", test_depth_only},
+    {"tile cache", test_tile_cache},
+    {NULL, NULL}
+};
@@ -4,6 +4,7 @@
 #include "MixColorShader.h"
 #include "VertexUtils.h"
 #include "transforms.h"
+#include "Animation.h"
 
 struct Metaball{
 	float a;
@@ -66,26 +67,19 @@ int main(){
 	Triangles T{P.size()};
 
 	int w = 800, h = 800;
-	ImageRGB G{w, h};
 	
 	mat4 View = lookAt({2.5, 2.5, 1.5}, {0, 0, 0}, {0, 0, 1});
 	float a = w/(float)h;
 	mat4 Projection = perspective(45, a, 0.1, 100);
 
 	int nframes = 80;
-	for(int k = 0; k < nframes; k++){
-		G.fill(white);
-		ImageZBuffer I{G};
-		
+	render_animation(nframes, w, h, white, "output%03d.png", [&](int k, ImageZBuffer& I){
 		float theta = k*2*M_PI/(nframes-1);
 		mat4 Model = rotate_z(theta);
-		shader.M = Projection*View*Model;
 
-		render(P, T, shader, I);
-		
-		char filename[30];
-		sprintf(filename, "output%03d.png", k);
-		puts(filename);
-		G.savePNG(filename);
-	}
+		MixColorShader frame_shader = shader;
+		frame_shader.M = Projection*View*Model;
+
+		render(P, T, frame_shader, I);
+	});
 }